@@ -1,51 +1,152 @@
+#include <glib-unix.h>
 #include <gtk/gtk.h>
+#include <errno.h>
+#include <limits.h>
+#include <stdio.h>
 #include <stdlib.h>
-#include <time.h>
 #include <string.h>
 #include <stdbool.h>
+#include <unistd.h>
 
-// Game constants
-#define BOARD_WIDTH 10
-#define BOARD_HEIGHT 20
-#define BLOCK_SIZE 30
-#define LEVEL_THRESHOLD 5000
+#include "tetris_ai.h"
+#include "tetris_cli.h"
+#include "tetris_engine.h"
+#include "tetris_net.h"
+#include "tetris_profile.h"
+#include "tetris_replay.h"
+#include "tetris_telemetry.h"
+
+// Frontend constants
+#define BLOCK_SIZE 30         // Initial cell size; the board scales with the window
+#define MIN_BLOCK_SIZE 10
 #define PREVIEW_SIZE 5
-#define MAX_LEVEL 10  // Added maximum level to prevent integer overflow
 #define SCORE_TEXT_SIZE 50
+#define MAX_CATCHUP_STEPS 4  // Gravity steps per frame before dropping backlog
+#define DEFAULT_DAS_MS 133   // Delayed Auto Shift: hold time before repeating
+#define DEFAULT_ARR_MS 33    // Auto Repeat Rate: interval between repeats, 0 = instant
+#define SOFT_DROP_MS 33      // Repeat interval while Down is held
+#define OVERLAY_X 4
+#define OVERLAY_Y 4
+#define OVERLAY_WIDTH 190
+#define OVERLAY_HEIGHT 58
+
+static GameState game = {0};
+static uint64_t next_seed;
+// Values the score label shows, so a lock that changes neither skips the
+// formatting and the label relayout
+static struct {
+    int score, level;
+} label_shown = {-1, -1};
+static TetrisRandomizer randomizer;
+static int preview_count = 1;  // Upcoming pieces shown, at most PREVIEW_DEPTH
+static bool autoplay;  // Let the placement search steer every new piece
+
+// --record: every effective input of the current game goes to this file
+static const char *record_path;
+static ReplayWriter recorder;
+
+// --save: the game left running on exit is saved here and resumed, paused,
+// on the next start
+static const char *save_path;
+
+// --telemetry NAME: events and lock latency of the window's games
+static struct {
+    Telemetry region;
+    TelemetryRing *ring;  // NULL when not exporting
+    uint32_t game;        // Games started so far
+} report;
 
-// Secure structure for tetromino data
+// --replay FILE --watch: recorded inputs drive the game instead of the keyboard
+static struct {
+    bool active;
+    bool has_next;  // Next input decoded and waiting for its tick
+    uint32_t tick;
+    TetrisInput input;
+    ReplayReader reader;
+    uint8_t *data;
+} playback;
+
+// --connect HOST:PORT: the game mirrors a --serve stream, no local clock
+static struct {
+    bool active;
+    int fd;
+    NetReader reader;
+} spectate = {.fd = -1};
+
+// Fixed-timestep game clock driven by the drawing area's frame clock
+static guint tick_id;
+static gint64 last_frame_time;
+static gint64 gravity_accumulator;  // Microseconds of unconsumed game time
+
+// A held key: time held so far and repeats already applied
 typedef struct {
-    int shape[4][2];
-    double color[3];
-} Tetromino;
-
-static const Tetromino tetrominoes[7] = {
-    {{{0,0}, {0,1}, {1,0}, {1,1}}, {1.0, 1.0, 0.0}}, // Square
-    {{{0,0}, {0,1}, {0,2}, {0,3}}, {0.0, 1.0, 1.0}}, // Line
-    {{{0,0}, {0,1}, {1,1}, {1,2}}, {1.0, 0.0, 0.0}}, // Z
-    {{{0,1}, {0,2}, {1,0}, {1,1}}, {0.0, 1.0, 0.0}}, // S
-    {{{0,0}, {0,1}, {0,2}, {1,1}}, {1.0, 0.0, 1.0}}, // T
-    {{{0,0}, {1,0}, {2,0}, {2,1}}, {1.0, 0.5, 0.0}}, // L
-    {{{0,1}, {1,1}, {2,0}, {2,1}}, {0.0, 0.0, 1.0}}  // J
+    bool down;
+    gint64 held;  // Microseconds
+    int moves;
+} HeldKey;
+
+// Key state sampled once per frame, independent of the X server's repeat
+static struct {
+    HeldKey left, right, soft_drop;
+    int shift_dir;  // -1/1 for the most recently pressed of Left/Right, 0 if none
+    bool rotate;    // Edge-triggered, consumed on the next frame
+    bool hard_drop;
+    gint64 das_us, arr_us;
+} input = {
+    .das_us = DEFAULT_DAS_MS * 1000,
+    .arr_us = DEFAULT_ARR_MS * 1000,
 };
 
-// Game state structure
-typedef struct {
-    int board[BOARD_HEIGHT][BOARD_WIDTH];
-    int board_colors[BOARD_HEIGHT][BOARD_WIDTH];
-    int current_x, current_y;
-    int current_piece[4][2];
-    int current_type, next_type;
-    int score;
-    int level;
-    int game_speed;
-    char score_text[SCORE_TEXT_SIZE];
-    bool game_over;
-    bool paused;
-    guint timeout_id;
-} GameState;
+// Board geometry, derived from the drawing area's allocation
+static struct {
+    int block;  // Cell size in logical pixels
+    int x, y;   // Board origin inside the drawing area
+} layout = {.block = BLOCK_SIZE};
 
-static GameState game = {0};
+// Pre-rasterized bevelled cell tiles, one per color, for the block size and
+// scale factor they were built at. Each is a repeating pattern aligned to
+// the cell grid, so a whole color still goes out as one fill.
+#define GARBAGE_TILE TETROMINO_COUNT  // Occupied cells with no tetromino color
+static struct {
+    cairo_pattern_t *tiles[TETROMINO_COUNT + 1];
+    int block, scale;
+} atlas;
+
+// Text drawn over the board, shaped once. A PangoLayout keeps its glyph runs
+// until its text changes, so redraws only paint them. The layouts belong to
+// the drawing area's Pango context and are dropped when its screen changes.
+#define OVERLAY_TEXT_SIZE 192
+static struct {
+    PangoLayout *game_over;
+    PangoLayout *stats;
+    char stats_text[OVERLAY_TEXT_SIZE];  // What stats currently holds
+} text;
+
+// Offscreen copy of the background and settled stack, redrawn only when the
+// board mutates
+static cairo_surface_t *stack_surface;
+static bool stack_dirty = true;
+static int stack_block, stack_scale;  // Geometry the surface was created for
+
+// Falling piece and its ghost as last invalidated, for dirty-region tracking
+static struct {
+    int type, rotation, x, y;
+    int ghost_y;
+} drawn_piece;
+
+// Hot-path probes and the F3 performance overlay
+static struct {
+    ProfHistogram frame, tick, lock, draw;
+    bool overlay;
+    gint64 window_start;  // Start of the current ticks-per-second window
+    int window_ticks;
+    int ticks_per_second;
+} prof = {
+    .frame = {.name = "frame interval"},
+    .tick = {.name = "frame tick"},
+    .lock = {.name = "lock+clear_lines"},
+    .draw = {.name = "draw_callback"},
+};
 
 // Widget pointers
 static struct {
@@ -56,309 +157,955 @@ static struct {
     GtkWidget *preview_area;
 } widgets;
 
+// Redraw scheduler: game code marks what it changed and the marks are
+// flushed to GTK at most once per frame clock update, however many inputs
+// and gravity steps landed in between
+static struct {
+    cairo_region_t *board;  // Dirty part of the drawing area, widget coordinates
+    bool board_all;
+    bool preview;
+    bool score;
+    GdkFrameClock *clock;   // The drawing area's clock, once it is realized
+} redraw;
+
 // Function prototypes with added security attributes
-static void new_piece(void) __attribute__((nonnull));
-static gboolean game_loop(gpointer data) __attribute__((warn_unused_result));
+static gboolean frame_tick(GtkWidget *widget, GdkFrameClock *clock, gpointer data);
 static void secure_strcpy(char *dest, size_t dest_size, const char *src);
 
-// Initialize game state securely
-static void init_game_state(void) {
-    memset(&game, 0, sizeof(GameState));
-    game.game_speed = 500;
-    game.level = 1;
+static void update_score_label(void) {
+    if (game.score == label_shown.score && game.level == label_shown.level) return;
+    label_shown.score = game.score;
+    label_shown.level = game.level;
+    // Use snprintf for buffer overflow protection
+    char text[SCORE_TEXT_SIZE];
+    snprintf(text, SCORE_TEXT_SIZE, "Score: %d  Level: %d", game.score, game.level);
+    gtk_label_set_text(GTK_LABEL(widgets.score_label), text);
 }
 
-// Secure random number generator
-static int secure_rand(int max) {
-    return (int)((double)rand() / (RAND_MAX + 1.0) * max);
+static void schedule_flush(void) {
+    if (redraw.clock) gdk_frame_clock_request_phase(redraw.clock, GDK_FRAME_CLOCK_PHASE_UPDATE);
 }
 
-void start_new_game(GtkButton *button, gpointer data) {
-    init_game_state();
-    if (game.timeout_id) {
-        g_source_remove(game.timeout_id);
+// Mark a rectangle of the drawing area, in widget coordinates
+static void mark_area(int x, int y, int width, int height) {
+    cairo_rectangle_int_t rect = {x, y, width, height};
+    cairo_region_union_rectangle(redraw.board, &rect);
+    schedule_flush();
+}
+
+static void mark_board(void) {
+    redraw.board_all = true;
+    schedule_flush();
+}
+
+static void mark_preview(void) {
+    redraw.preview = true;
+    schedule_flush();
+}
+
+static void mark_score(void) {
+    redraw.score = true;
+    schedule_flush();
+}
+
+static void flush_redraws(void) {
+    if (redraw.board_all) {
+        gtk_widget_queue_draw(widgets.drawing_area);
+    } else if (!cairo_region_is_empty(redraw.board)) {
+        gtk_widget_queue_draw_region(widgets.drawing_area, redraw.board);
     }
-    game.timeout_id = g_timeout_add(game.game_speed, game_loop, NULL);
-    
-    // Use snprintf for buffer overflow protection
-    snprintf(game.score_text, SCORE_TEXT_SIZE, "Score: %d  Level: %d", 
-             game.score, game.level);
-    gtk_label_set_text(GTK_LABEL(widgets.score_label), game.score_text);
+    if (!cairo_region_is_empty(redraw.board)) {
+        cairo_region_destroy(redraw.board);
+        redraw.board = cairo_region_create();
+    }
+    if (redraw.preview) gtk_widget_queue_draw(widgets.preview_area);
+    if (redraw.score) update_score_label();
+    redraw.board_all = redraw.preview = redraw.score = false;
+}
+
+static void clock_update(GdkFrameClock *clock, gpointer data) {
+    flush_redraws();
+}
+
+// The frame clock only exists once the drawing area is realized
+void board_realized(GtkWidget *widget, gpointer data) {
+    redraw.clock = gtk_widget_get_frame_clock(widget);
+    g_signal_connect(redraw.clock, "update", G_CALLBACK(clock_update), NULL);
+    schedule_flush();
+}
+
+static void press_key(HeldKey *key) {
+    // Ignore the X server's auto-repeat, repeats are generated per frame
+    if (key->down) return;
+    key->down = true;
+    key->held = 0;
+    key->moves = 0;
+}
+
+static void release_key(HeldKey *key) {
+    key->down = false;
+}
+
+static void reset_input(void) {
+    release_key(&input.left);
+    release_key(&input.right);
+    release_key(&input.soft_drop);
+    input.shift_dir = 0;
+    input.rotate = false;
+    input.hard_drop = false;
+}
+
+// Queue a repaint of a rectangle of board cells
+static void invalidate_cells(int x, int y, int width, int height) {
+    mark_area(layout.x + x * layout.block, layout.y + y * layout.block,
+              width * layout.block, height * layout.block);
+}
+
+static int ghost_row(void) {
+    return tetris_landing_row(&game, game.current_type, game.current_rotation,
+                              game.current_x, game.current_y);
+}
+
+static void remember_piece(int ghost_y) {
+    drawn_piece.type = game.current_type;
+    drawn_piece.rotation = game.current_rotation;
+    drawn_piece.x = game.current_x;
+    drawn_piece.y = game.current_y;
+    drawn_piece.ghost_y = ghost_y;
+}
+
+static void invalidate_board(void) {
+    stack_dirty = true;
+    mark_board();
+    remember_piece(ghost_row());
+}
+
+// Invalidate the old and new bounding boxes of the falling piece and its
+// ghost if either moved
+static void invalidate_piece(void) {
+    int ghost_y = ghost_row();
+    if (drawn_piece.type == game.current_type &&
+        drawn_piece.rotation == game.current_rotation &&
+        drawn_piece.x == game.current_x && drawn_piece.y == game.current_y &&
+        drawn_piece.ghost_y == ghost_y) {
+        return;
+    }
+    const PieceRotation *old = &piece_rotations[drawn_piece.type][drawn_piece.rotation];
+    invalidate_cells(drawn_piece.x, drawn_piece.y, old->width, old->height);
+    invalidate_cells(drawn_piece.x, drawn_piece.ghost_y, old->width, old->height);
+    const PieceRotation *piece = tetris_current_piece(&game);
+    invalidate_cells(game.current_x, game.current_y, piece->width, piece->height);
+    invalidate_cells(game.current_x, ghost_y, piece->width, piece->height);
+
+    remember_piece(ghost_y);
+}
+
+// (Re)start the game clock from the next frame, discarding accumulated time
+static void start_clock(void) {
+    last_frame_time = 0;
+    gravity_accumulator = 0;
+    if (!tick_id) {
+        tick_id = gtk_widget_add_tick_callback(widgets.drawing_area, frame_tick, NULL, NULL);
+    }
+}
+
+static void stop_clock(void) {
+    if (tick_id) {
+        gtk_widget_remove_tick_callback(widgets.drawing_area, tick_id);
+        tick_id = 0;
+    }
+}
+
+// Write the footer of the current recording, if any
+static void finish_recording(void) {
+    if (recorder.open && !replay_writer_close(&recorder, &game)) {
+        fprintf(stderr, "record: could not write %s\n", record_path);
+    }
+}
+
+// Start a game from seed, recording it over the previous one with --record
+static void begin_game(uint64_t seed) {
+    finish_recording();
+    tetris_init_randomizer(&game, seed, randomizer);
+    if (record_path && !replay_writer_open(&recorder, record_path, seed, randomizer)) {
+        fprintf(stderr, "record: could not open %s\n", record_path);
+    }
+    if (report.ring) {
+        telemetry_game_start(report.ring, report.region.header->capacity, ++report.game, &game);
+    }
+}
+
+void start_new_game(GtkButton *button, gpointer data) {
+    playback.active = false;
+    begin_game(next_seed++);
+    reset_input();
+    start_clock();
+    mark_score();
     gtk_button_set_label(GTK_BUTTON(widgets.pause_button), "Pause");
-    new_piece();
-    gtk_widget_queue_draw(widgets.drawing_area);
+    mark_preview();
+    invalidate_board();
 }
 
 void toggle_pause(GtkButton *button, gpointer data) {
     if (game.game_over) return;
     game.paused = !game.paused;
-    gtk_button_set_label(GTK_BUTTON(widgets.pause_button), 
+    // Let the frame clock idle while paused
+    if (game.paused) {
+        stop_clock();
+    } else {
+        start_clock();
+    }
+    gtk_button_set_label(GTK_BUTTON(widgets.pause_button),
                         game.paused ? "Resume" : "Pause");
 }
 
-void new_piece(void) {
-    game.current_type = game.next_type;
-    game.next_type = secure_rand(7);
-    game.current_x = BOARD_WIDTH / 2 - 2;
-    game.current_y = 0;
-    
-    memcpy(game.current_piece, tetrominoes[game.current_type].shape, 
-           sizeof(game.current_piece));
-    gtk_widget_queue_draw(widgets.preview_area);
-}
-
 // Optimized drawing functions with boundary checking
 gboolean draw_preview(GtkWidget *widget, cairo_t *cr, gpointer data) {
     cairo_set_source_rgb(cr, 0.2, 0.2, 0.2);
     cairo_paint(cr);
-    
-    cairo_set_source_rgb(cr, 0.5, 0.5, 0.5);
-    cairo_rectangle(cr, 5, 5, PREVIEW_SIZE * BLOCK_SIZE/2 - 10, 
-                   PREVIEW_SIZE * BLOCK_SIZE/2 - 10);
-    cairo_stroke(cr);
-    
-    const double *color = tetrominoes[game.next_type].color;
-    cairo_set_source_rgb(cr, color[0], color[1], color[2]);
-    
-    for (int i = 0; i < 4; i++) {
-        int x = tetrominoes[game.next_type].shape[i][0] + 1;
-        int y = tetrominoes[game.next_type].shape[i][1] + 1;
-        cairo_rectangle(cr, x * BLOCK_SIZE/2, y * BLOCK_SIZE/2,
-                       BLOCK_SIZE/2 - 1, BLOCK_SIZE/2 - 1);
+
+    // One framed box per upcoming piece, the next one on top
+    for (int k = 0; k < preview_count; k++) {
+        int top = k * PREVIEW_SIZE * BLOCK_SIZE/2;
+        int type = tetris_preview(&game, k);
+
+        cairo_set_source_rgb(cr, 0.5, 0.5, 0.5);
+        cairo_rectangle(cr, 5, top + 5, PREVIEW_SIZE * BLOCK_SIZE/2 - 10,
+                       PREVIEW_SIZE * BLOCK_SIZE/2 - 10);
+        cairo_stroke(cr);
+
+        const double *color = tetrominoes[type].color;
+        cairo_set_source_rgb(cr, color[0], color[1], color[2]);
+        for (int i = 0; i < 4; i++) {
+            int x = tetrominoes[type].shape[i][0] + 1;
+            int y = tetrominoes[type].shape[i][1] + 1;
+            cairo_rectangle(cr, x * BLOCK_SIZE/2, top + y * BLOCK_SIZE/2,
+                           BLOCK_SIZE/2 - 1, BLOCK_SIZE/2 - 1);
+        }
         cairo_fill(cr);
     }
     return TRUE;
 }
 
-gboolean draw_callback(GtkWidget *widget, cairo_t *cr, gpointer data) {
+// Fit the board into the allocation, keeping cells square and centered
+void board_allocated(GtkWidget *widget, GdkRectangle *allocation, gpointer data) {
+    int block = MIN(allocation->width / BOARD_WIDTH, allocation->height / BOARD_HEIGHT);
+    layout.block = MAX(block, MIN_BLOCK_SIZE);
+    layout.x = MAX(0, (allocation->width - BOARD_WIDTH * layout.block) / 2);
+    layout.y = MAX(0, (allocation->height - BOARD_HEIGHT * layout.block) / 2);
+}
+
+// Fill a block x block cell at the origin: base color with a lighter
+// top-left and darker bottom-right bevel, leaving a one pixel gap
+static void draw_tile(cairo_t *cr, const double *color, int block) {
+    double size = block - 1;
+    double bevel = MAX(1, block / 8);
+    cairo_set_source_rgb(cr, color[0], color[1], color[2]);
+    cairo_rectangle(cr, 0, 0, size, size);
+    cairo_fill(cr);
+
+    cairo_set_source_rgba(cr, 1.0, 1.0, 1.0, 0.35);
+    cairo_move_to(cr, 0, 0);
+    cairo_line_to(cr, size, 0);
+    cairo_line_to(cr, size - bevel, bevel);
+    cairo_line_to(cr, bevel, bevel);
+    cairo_line_to(cr, bevel, size - bevel);
+    cairo_line_to(cr, 0, size);
+    cairo_close_path(cr);
+    cairo_fill(cr);
+
+    cairo_set_source_rgba(cr, 0.0, 0.0, 0.0, 0.35);
+    cairo_move_to(cr, size, size);
+    cairo_line_to(cr, 0, size);
+    cairo_line_to(cr, bevel, size - bevel);
+    cairo_line_to(cr, size - bevel, size - bevel);
+    cairo_line_to(cr, size - bevel, bevel);
+    cairo_line_to(cr, size, 0);
+    cairo_close_path(cr);
+    cairo_fill(cr);
+}
+
+// Rebuild the tiles and drop the stack surface when the block size or the
+// monitor's scale factor changed. Surfaces come from the widget's window, so
+// they carry its device scale and rasterize at full resolution.
+static void update_caches(GtkWidget *widget) {
+    int scale = gtk_widget_get_scale_factor(widget);
+    if (stack_surface && (stack_block != layout.block || stack_scale != scale)) {
+        cairo_surface_destroy(stack_surface);
+        stack_surface = NULL;
+    }
+    if (atlas.tiles[0] && atlas.block == layout.block && atlas.scale == scale) return;
+
+    GdkWindow *window = gtk_widget_get_window(widget);
+    static const double garbage_color[3] = {0.45, 0.45, 0.45};
+    for (int c = 0; c <= GARBAGE_TILE; c++) {
+        if (atlas.tiles[c]) cairo_pattern_destroy(atlas.tiles[c]);
+        cairo_surface_t *tile = gdk_window_create_similar_surface(
+            window, CAIRO_CONTENT_COLOR_ALPHA, layout.block, layout.block);
+        cairo_t *cr = cairo_create(tile);
+        draw_tile(cr, c == GARBAGE_TILE ? garbage_color : tetrominoes[c].color, layout.block);
+        cairo_destroy(cr);
+        atlas.tiles[c] = cairo_pattern_create_for_surface(tile);
+        cairo_pattern_set_extend(atlas.tiles[c], CAIRO_EXTEND_REPEAT);
+        cairo_surface_destroy(tile);
+    }
+    atlas.block = layout.block;
+    atlas.scale = scale;
+}
+
+// Add one cell to the current path in board coordinates
+static void cell_path(cairo_t *cr, int x, int y) {
+    cairo_rectangle(cr, x * layout.block, y * layout.block, layout.block, layout.block);
+}
+
+static void render_stack(GtkWidget *widget) {
+    if (!stack_surface) {
+        stack_surface = gdk_window_create_similar_surface(
+            gtk_widget_get_window(widget), CAIRO_CONTENT_COLOR,
+            BOARD_WIDTH * layout.block, BOARD_HEIGHT * layout.block);
+        stack_block = layout.block;
+        stack_scale = gtk_widget_get_scale_factor(widget);
+    }
+    cairo_t *cr = cairo_create(stack_surface);
     cairo_set_source_rgb(cr, 0.1, 0.1, 0.1);
     cairo_paint(cr);
 
-    // Draw board
+    // Bucket occupied cells by color so each color is a single path and fill
+    uint16_t cells[GARBAGE_TILE + 1][BOARD_WIDTH * BOARD_HEIGHT];
+    int counts[GARBAGE_TILE + 1] = {0};
     for (int y = 0; y < BOARD_HEIGHT; y++) {
-        for (int x = 0; x < BOARD_WIDTH; x++) {
-            if (game.board[y][x]) {
-                int color_idx = game.board_colors[y][x] - 1;
-                if (color_idx >= 0 && color_idx < 7) {
-                    const double *color = tetrominoes[color_idx].color;
-                    cairo_set_source_rgb(cr, color[0], color[1], color[2]);
-                    cairo_rectangle(cr, x * BLOCK_SIZE, y * BLOCK_SIZE, 
-                                  BLOCK_SIZE - 1, BLOCK_SIZE - 1);
-                    cairo_fill(cr);
-                }
-            }
+        for (uint32_t bits = game.rows[y]; bits; bits &= bits - 1) {
+            int x = __builtin_ctz(bits);
+            int color = tetris_cell_color(&game, x, y);
+            int color_idx = color ? color - 1 : GARBAGE_TILE;
+            cells[color_idx][counts[color_idx]++] = (uint16_t)(y * BOARD_WIDTH + x);
         }
     }
 
-    // Draw current piece
-    const double *current_color = tetrominoes[game.current_type].color;
-    cairo_set_source_rgb(cr, current_color[0], current_color[1], current_color[2]);
-    for (int i = 0; i < 4; i++) {
-        int x = game.current_x + game.current_piece[i][0];
-        int y = game.current_y + game.current_piece[i][1];
-        if (y >= 0 && x >= 0 && x < BOARD_WIDTH) {
-            cairo_rectangle(cr, x * BLOCK_SIZE, y * BLOCK_SIZE,
-                          BLOCK_SIZE - 1, BLOCK_SIZE - 1);
-            cairo_fill(cr);
+    // Draw board
+    for (int c = 0; c <= GARBAGE_TILE; c++) {
+        if (!counts[c]) continue;
+        cairo_set_source(cr, atlas.tiles[c]);
+        for (int i = 0; i < counts[c]; i++) {
+            cell_path(cr, cells[c][i] % BOARD_WIDTH, cells[c][i] / BOARD_WIDTH);
         }
+        cairo_fill(cr);
     }
+    cairo_destroy(cr);
+    stack_dirty = false;
+}
+
+static PangoLayout *text_layout(GtkWidget *widget, const char *font, int pixels) {
+    PangoLayout *layout = gtk_widget_create_pango_layout(widget, NULL);
+    PangoFontDescription *desc = pango_font_description_from_string(font);
+    pango_font_description_set_absolute_size(desc, pixels * PANGO_SCALE);
+    pango_layout_set_font_description(layout, desc);
+    pango_font_description_free(desc);
+    return layout;
+}
+
+void drop_text_layouts(GtkWidget *widget, GdkScreen *previous, gpointer data) {
+    g_clear_object(&text.game_over);
+    g_clear_object(&text.stats);
+    text.stats_text[0] = '\0';
+}
+
+static void draw_overlay(GtkWidget *widget, cairo_t *cr) {
+    cairo_set_source_rgba(cr, 0.0, 0.0, 0.0, 0.7);
+    cairo_rectangle(cr, OVERLAY_X, OVERLAY_Y, OVERLAY_WIDTH, OVERLAY_HEIGHT);
+    cairo_fill(cr);
+
+    // The percentiles only move between histogram buckets, so most frames
+    // format the same text and reuse the shaped layout
+    char stats[OVERLAY_TEXT_SIZE];
+    snprintf(stats, sizeof(stats), "frame %6.2f ms\ndraw p50 %4.0f p99 %4.0f us\nticks/s %d",
+             prof_percentile(&prof.frame, 0.50) / 1e6,
+             prof_percentile(&prof.draw, 0.50) / 1e3,
+             prof_percentile(&prof.draw, 0.99) / 1e3, prof.ticks_per_second);
+    if (!text.stats) {
+        text.stats = text_layout(widget, "Monospace", 12);
+        pango_layout_set_spacing(text.stats, 2 * PANGO_SCALE);
+    }
+    if (strcmp(stats, text.stats_text) != 0) {
+        memcpy(text.stats_text, stats, sizeof(stats));
+        pango_layout_set_text(text.stats, stats, -1);
+    }
+    cairo_set_source_rgb(cr, 0.8, 1.0, 0.8);
+    cairo_move_to(cr, OVERLAY_X + 6, OVERLAY_Y + 4);
+    pango_cairo_show_layout(cr, text.stats);
+}
+
+gboolean draw_callback(GtkWidget *widget, cairo_t *cr, gpointer data) {
+    uint64_t start = prof_now_ns();
+    update_caches(widget);
+
+    // Margins around the board when the window is not the board's shape
+    cairo_set_source_rgb(cr, 0.05, 0.05, 0.05);
+    cairo_paint(cr);
+
+    // Blit the cached stack, clipped to the invalidated area
+    cairo_save(cr);
+    cairo_translate(cr, layout.x, layout.y);
+    if (!stack_surface || stack_dirty) render_stack(widget);
+    cairo_set_source_surface(cr, stack_surface, 0, 0);
+    cairo_paint(cr);
+
+    // Draw the ghost at the landing row, then the current piece over it
+    const PieceRotation *piece = tetris_current_piece(&game);
+    cairo_pattern_t *tile = atlas.tiles[game.current_type];
+    if (!game.game_over) {
+        int ghost_y = drawn_piece.ghost_y;
+        cairo_save(cr);
+        for (int i = 0; i < 4; i++) {
+            int x = game.current_x + piece->cells[i][0];
+            int y = ghost_y + piece->cells[i][1];
+            if (y >= 0 && x >= 0 && x < BOARD_WIDTH) cell_path(cr, x, y);
+        }
+        cairo_clip(cr);
+        cairo_set_source(cr, tile);
+        cairo_paint_with_alpha(cr, 0.25);
+        cairo_restore(cr);
+    }
+
+    cairo_set_source(cr, tile);
+    for (int i = 0; i < 4; i++) {
+        int x = game.current_x + piece->cells[i][0];
+        int y = game.current_y + piece->cells[i][1];
+        if (y >= 0 && x >= 0 && x < BOARD_WIDTH) cell_path(cr, x, y);
+    }
+    cairo_fill(cr);
 
     // Draw game over screen
     if (game.game_over) {
+        int cx = BOARD_WIDTH * layout.block / 2, cy = BOARD_HEIGHT * layout.block / 2;
         cairo_set_source_rgba(cr, 0.0, 0.0, 0.0, 0.9);
-        cairo_rectangle(cr, BOARD_WIDTH * BLOCK_SIZE/2 - 100, 
-                       BOARD_HEIGHT * BLOCK_SIZE/2 - 40, 200, 80);
+        cairo_rectangle(cr, cx - 100, cy - 40, 200, 80);
         cairo_fill(cr);
-        
+
         cairo_set_source_rgb(cr, 0.5, 0.5, 0.5);
-        cairo_rectangle(cr, BOARD_WIDTH * BLOCK_SIZE/2 - 100, 
-                       BOARD_HEIGHT * BLOCK_SIZE/2 - 40, 200, 80);
+        cairo_rectangle(cr, cx - 100, cy - 40, 200, 80);
         cairo_stroke(cr);
-        
+
+        if (!text.game_over) {
+            text.game_over = text_layout(widget, "Sans Bold", 40);
+            pango_layout_set_text(text.game_over, "GAME OVER", -1);
+        }
+        int width, height;
+        pango_layout_get_pixel_size(text.game_over, &width, &height);
         cairo_set_source_rgb(cr, 1.0, 1.0, 1.0);
-        cairo_select_font_face(cr, "Sans", CAIRO_FONT_SLANT_NORMAL, 
-                             CAIRO_FONT_WEIGHT_BOLD);
-        cairo_set_font_size(cr, 40);
-        cairo_move_to(cr, BOARD_WIDTH * BLOCK_SIZE/2 - 90, 
-                     BOARD_HEIGHT * BLOCK_SIZE/2 + 15);
-        cairo_show_text(cr, "GAME OVER");
+        cairo_move_to(cr, cx - width / 2, cy - height / 2);
+        pango_cairo_show_layout(cr, text.game_over);
     }
+    cairo_restore(cr);
+
+    if (prof.overlay) draw_overlay(widget, cr);
+    prof_record_since(&prof.draw, start);
     return TRUE;
 }
 
-static bool can_move(int dx, int dy) {
-    for (int i = 0; i < 4; i++) {
-        int new_x = game.current_x + game.current_piece[i][0] + dx;
-        int new_y = game.current_y + game.current_piece[i][1] + dy;
-        if (new_x < 0 || new_x >= BOARD_WIDTH || new_y >= BOARD_HEIGHT ||
-            (new_y >= 0 && game.board[new_y][new_x])) {
-            return false;
-        }
+// Apply a player input, recording it if it had any effect
+static unsigned do_input(TetrisInput in) {
+    unsigned events = tetris_apply_input(&game, in);
+    if (events && recorder.open) replay_write_input(&recorder, game.ticks, in);
+    return events;
+}
+
+static void autoplay_piece(void) {
+    AiMove move;
+    if (!autoplay || !ai_best_move(&game, &ai_default_weights, NULL, &move)) return;
+    // Same steering as ai_apply_move, but through do_input so it is recorded
+    for (int r = 0; r < 4 && game.current_rotation != move.rotation; r++) {
+        if (!do_input(TETRIS_INPUT_ROTATE)) break;
     }
+    TetrisInput shift = move.x < game.current_x ? TETRIS_INPUT_LEFT : TETRIS_INPUT_RIGHT;
+    while (game.current_x != move.x) {
+        if (!do_input(shift)) break;
+    }
+}
+
+// Refresh whatever a lock or move touched; returns false once the game is over
+static bool apply_events(unsigned events) {
+    if (report.ring && (events & TETRIS_EVENT_LANDED)) {
+        telemetry_game_events(report.ring, report.region.header->capacity, report.game,
+                              &game, events);
+    }
+    if (events & TETRIS_EVENT_LINES) {
+        // Everything above the lowest cleared row shifted down
+        int lowest = 31 - __builtin_clz(game.cleared_rows);
+        invalidate_cells(0, 0, BOARD_WIDTH, lowest + 1);
+    }
+    if (events & TETRIS_EVENT_GARBAGE) invalidate_board();
+    if (events & TETRIS_EVENT_LANDED) {
+        stack_dirty = true;
+        mark_score();
+        mark_preview();
+    }
+    if (events & TETRIS_EVENT_GAME_OVER) {
+        finish_recording();
+        invalidate_board();
+        return false;
+    }
+    if (events & TETRIS_EVENT_LANDED) autoplay_piece();
+    invalidate_piece();
     return true;
 }
 
-static void land_piece(void) {
-    for (int i = 0; i < 4; i++) {
-        int x = game.current_x + game.current_piece[i][0];
-        int y = game.current_y + game.current_piece[i][1];
-        if (y >= 0 && x >= 0 && x < BOARD_WIDTH && y < BOARD_HEIGHT) {
-            game.board[y][x] = 1;
-            game.board_colors[y][x] = game.current_type + 1;
+// Lock latency since start, for the overlay and telemetry
+static void record_lock(uint64_t start) {
+    uint64_t ns = prof_now_ns() - start;
+    prof_record(&prof.lock, ns);
+    if (report.ring) telemetry_record(&report.ring->lock, ns);
+}
+
+// One gravity step; returns false once the game is over
+static bool gravity_step(void) {
+    uint64_t start = prof_now_ns();
+    unsigned events = tetris_tick(&game);
+    if (events & TETRIS_EVENT_LANDED) record_lock(start);
+    prof.window_ticks++;
+    return apply_events(events);
+}
+
+// Hard drop straight to the ghost row; returns false once the game is over
+static bool hard_drop(void) {
+    uint64_t start = prof_now_ns();
+    unsigned events = do_input(TETRIS_INPUT_HARD_DROP);
+    if (events & TETRIS_EVENT_LANDED) record_lock(start);
+    // The next piece gets a full gravity interval
+    gravity_accumulator = 0;
+    return apply_events(events);
+}
+
+// Moves owed to a key after `held` microseconds: one on press, then one per
+// `repeat` once `delay` has elapsed. repeat == 0 means "as far as possible".
+static int due_moves(gint64 held, gint64 delay, gint64 repeat) {
+    if (held < delay) return 1;
+    if (repeat == 0) return INT_MAX;
+    gint64 due = 2 + (held - delay) / repeat;
+    return due > INT_MAX ? INT_MAX : (int)due;
+}
+
+static void repeat_key(HeldKey *key, gint64 elapsed, gint64 delay, gint64 repeat,
+                       TetrisInput in) {
+    int due = due_moves(key->held, delay, repeat);
+    key->held += elapsed;
+    while (key->moves < due) {
+        if (!do_input(in)) {
+            // Blocked: drop the owed moves, an instant repeat retries next frame
+            if (due != INT_MAX) key->moves = due;
+            break;
         }
+        key->moves++;
     }
 }
 
-static void clear_lines(void) {
-    int lines = 0;
-    for (int y = BOARD_HEIGHT - 1; y >= 0; y--) {
-        bool full = true;
-        for (int x = 0; x < BOARD_WIDTH; x++) {
-            if (!game.board[y][x]) {
-                full = false;
-                break;
-            }
+// Sample the key state; called once per frame before gravity
+static void process_input(gint64 elapsed) {
+    if (input.rotate) {
+        do_input(TETRIS_INPUT_ROTATE);
+        input.rotate = false;
+    }
+    HeldKey *shift = input.shift_dir < 0 ? &input.left : &input.right;
+    if (input.shift_dir && shift->down) {
+        repeat_key(shift, elapsed, input.das_us, input.arr_us,
+                   input.shift_dir < 0 ? TETRIS_INPUT_LEFT : TETRIS_INPUT_RIGHT);
+    }
+    if (input.soft_drop.down) {
+        repeat_key(&input.soft_drop, elapsed, SOFT_DROP_MS * 1000, SOFT_DROP_MS * 1000,
+                   TETRIS_INPUT_SOFT_DROP);
+    }
+}
+
+static void playback_fetch(void) {
+    int next = replay_reader_next(&playback.reader, &playback.tick, &playback.input);
+    if (next < 0) fprintf(stderr, "replay: corrupt input stream\n");
+    playback.has_next = next > 0;
+}
+
+// Feed the recorded inputs due at the current tick, then run gravity. At most
+// one piece is dropped per step, so bot recordings, which never wait on
+// gravity, play back at one piece per step instead of all at once. Returns
+// false once the game or the recording is over.
+static bool playback_step(void) {
+    while (playback.has_next && playback.tick == game.ticks) {
+        TetrisInput in = playback.input;
+        unsigned events = tetris_apply_input(&game, in);
+        if (!events) {
+            fprintf(stderr, "replay: diverged at tick %u\n", game.ticks);
+            playback.active = false;
+            return false;
         }
-        if (full) {
-            lines++;
-            for (int yy = y; yy > 0; yy--) {
-                memcpy(game.board[yy], game.board[yy-1], 
-                       sizeof(game.board[yy]));
-                memcpy(game.board_colors[yy], game.board_colors[yy-1],
-                       sizeof(game.board_colors[yy]));
-            }
-            memset(game.board[0], 0, sizeof(game.board[0]));
-            memset(game.board_colors[0], 0, sizeof(game.board_colors[0]));
-            y++;
+        playback_fetch();
+        if (!apply_events(events)) return false;
+        if (in == TETRIS_INPUT_HARD_DROP) return true;
+    }
+    if (!playback.has_next && game.ticks >= playback.reader.info.ticks) {
+        playback.active = false;
+        return false;
+    }
+    return gravity_step();
+}
+
+static void invalidate_overlay(void) {
+    mark_area(OVERLAY_X, OVERLAY_Y, OVERLAY_WIDTH, OVERLAY_HEIGHT);
+}
+
+// Roll the ticks-per-second window and refresh the overlay if it is shown
+static void update_tick_rate(gint64 now) {
+    if (now - prof.window_start >= G_USEC_PER_SEC) {
+        prof.ticks_per_second = prof.window_ticks;
+        prof.window_ticks = 0;
+        prof.window_start = now;
+    }
+    if (prof.overlay) invalidate_overlay();
+}
+
+// Frame clock callback: sample input, then consume elapsed monotonic time in
+// fixed gravity steps. A level-up only changes the step length, no source is
+// recreated.
+static gboolean frame_tick(GtkWidget *widget, GdkFrameClock *clock, gpointer data) {
+    uint64_t start = prof_now_ns();
+    gint64 now = gdk_frame_clock_get_frame_time(clock);
+    if (last_frame_time == 0) last_frame_time = now;
+    gint64 elapsed = now - last_frame_time;
+    gravity_accumulator += elapsed;
+    last_frame_time = now;
+    if (elapsed > 0) prof_record(&prof.frame, (uint64_t)elapsed * 1000);
+    update_tick_rate(now);
+
+    if (!playback.active) process_input(elapsed);
+    invalidate_piece();
+    if (input.hard_drop && !playback.active) {
+        input.hard_drop = false;
+        if (!hard_drop()) {
+            tick_id = 0;
+            flush_redraws();
+            prof_record_since(&prof.tick, start);
+            return G_SOURCE_REMOVE;
         }
     }
-    
-    // Prevent integer overflow
-    game.score = (game.score + lines * 100 * game.level > INT_MAX) ? 
-                 INT_MAX : game.score + lines * 100 * game.level;
-    
-    snprintf(game.score_text, SCORE_TEXT_SIZE, "Score: %d  Level: %d", 
-             game.score, game.level);
-    gtk_label_set_text(GTK_LABEL(widgets.score_label), game.score_text);
-    
-    if (game.score >= game.level * LEVEL_THRESHOLD && game.level < MAX_LEVEL) {
-        game.level++;
-        game.game_speed = 500 / game.level;
-        g_source_remove(game.timeout_id);
-        game.timeout_id = g_timeout_add(game.game_speed, game_loop, NULL);
-    }
-}
-
-gboolean game_loop(gpointer data) {
-    if (game.paused || game.game_over) return TRUE;
-    
-    if (can_move(0, 1)) {
-        game.current_y++;
-    } else {
-        land_piece();
-        clear_lines();
-        new_piece();
-        if (!can_move(0, 0)) {
-            game.game_over = true;
-            gtk_widget_queue_draw(widgets.drawing_area);
-            return FALSE;
+
+    for (int steps = 0; ; steps++) {
+        gint64 step = (gint64)game.game_speed * 1000;
+        if (gravity_accumulator < step) break;
+        if (steps == MAX_CATCHUP_STEPS) {
+            // Long stall (e.g. window hidden): resync instead of fast-forwarding
+            gravity_accumulator = 0;
+            break;
+        }
+        gravity_accumulator -= step;
+        if (!(playback.active ? playback_step() : gravity_step())) {
+            tick_id = 0;
+            flush_redraws();
+            prof_record_since(&prof.tick, start);
+            return G_SOURCE_REMOVE;
         }
     }
-    gtk_widget_queue_draw(widgets.drawing_area);
-    return TRUE;
+    // Flush here as well, in case the clock emitted our update handler first
+    flush_redraws();
+    prof_record_since(&prof.tick, start);
+    return G_SOURCE_CONTINUE;
 }
 
 gboolean key_press(GtkWidget *widget, GdkEventKey *event, gpointer data) {
-    if (game.game_over || !event) return TRUE;
+    if (!event) return TRUE;
+    if (event->keyval == GDK_KEY_F3) {
+        prof.overlay = !prof.overlay;
+        invalidate_overlay();
+        return TRUE;
+    }
+    if (game.game_over || spectate.active) return TRUE;
     if (event->keyval == GDK_KEY_p) toggle_pause(NULL, NULL);
-    
-    if (game.paused) return TRUE;
-    
+
+    if (game.paused || playback.active) return TRUE;
+
+    if (event->keyval == GDK_KEY_a) {
+        autoplay = !autoplay;
+        autoplay_piece();
+        return TRUE;
+    }
+
+    // Only record state here; movement happens on the next frame
     switch (event->keyval) {
         case GDK_KEY_Left:
-            if (can_move(-1, 0)) game.current_x--; 
+            press_key(&input.left);
+            input.shift_dir = -1;
             break;
         case GDK_KEY_Right:
-            if (can_move(1, 0)) game.current_x++; 
+            press_key(&input.right);
+            input.shift_dir = 1;
             break;
         case GDK_KEY_Down:
-            if (can_move(0, 1)) game.current_y++; 
+            press_key(&input.soft_drop);
             break;
         case GDK_KEY_Up:
-            int temp_piece[4][2];
-            memcpy(temp_piece, game.current_piece, sizeof(temp_piece));
-            for (int i = 0; i < 4; i++) {
-                int x = game.current_piece[i][0];
-                int y = game.current_piece[i][1];
-                game.current_piece[i][0] = y;
-                game.current_piece[i][1] = -x;
-            }
-            if (!can_move(0, 0)) {
-                memcpy(game.current_piece, temp_piece, sizeof(game.current_piece));
-            }
+            input.rotate = true;
+            break;
+        case GDK_KEY_space:
+            input.hard_drop = true;
+            break;
+    }
+    return TRUE;
+}
+
+gboolean key_release(GtkWidget *widget, GdkEventKey *event, gpointer data) {
+    if (!event) return TRUE;
+
+    switch (event->keyval) {
+        case GDK_KEY_Left:
+            release_key(&input.left);
+            // Fall back to the other direction if it is still held
+            if (input.shift_dir < 0) input.shift_dir = input.right.down ? 1 : 0;
+            if (input.shift_dir) input.right.held = input.right.moves = 0;
+            break;
+        case GDK_KEY_Right:
+            release_key(&input.right);
+            if (input.shift_dir > 0) input.shift_dir = input.left.down ? -1 : 0;
+            if (input.shift_dir) input.left.held = input.left.moves = 0;
+            break;
+        case GDK_KEY_Down:
+            release_key(&input.soft_drop);
             break;
     }
-    gtk_widget_queue_draw(widgets.drawing_area);
     return TRUE;
 }
 
+gboolean focus_out(GtkWidget *widget, GdkEvent *event, gpointer data) {
+    // Releases are not delivered while unfocused, so forget held keys
+    reset_input();
+    return FALSE;
+}
+
+static void spectate_close(void) {
+    close(spectate.fd);
+    spectate.fd = -1;
+}
+
+// Mirror the frames in from the server. Several can arrive in one read, so
+// instead of tracking each intermediate position the whole board is
+// repainted whenever a piece locked.
+static gboolean spectate_readable(gint fd, GIOCondition condition, gpointer data) {
+    NetReader *reader = &spectate.reader;
+    ssize_t got = read(fd, reader->buf + reader->len, sizeof(reader->buf) - reader->len);
+    if (got < 0 && (errno == EAGAIN || errno == EINTR)) return G_SOURCE_CONTINUE;
+    if (got <= 0) {
+        fprintf(stderr, "connect: server closed the connection\n");
+        spectate_close();
+        return G_SOURCE_REMOVE;
+    }
+    reader->len += (size_t)got;
+
+    unsigned events = 0;
+    bool snapshot = false;
+    NetApplyStatus status = net_reader_apply(reader, &game, &events, &snapshot);
+    if (snapshot || (events & TETRIS_EVENT_LANDED)) invalidate_board();
+    if (snapshot) {
+        mark_score();
+        mark_preview();
+    }
+    if (events) apply_events(events);
+    if (status != NET_APPLY_OK) {
+        fprintf(stderr, status == NET_APPLY_DESYNC ? "connect: lost sync with the server\n"
+                                                   : "connect: malformed frame from server\n");
+        spectate_close();
+        return G_SOURCE_REMOVE;
+    }
+    return G_SOURCE_CONTINUE;
+}
+
+// Split HOST:PORT and connect; the last colon separates the port
+static bool connect_spectator(const char *address) {
+    char host[256];
+    const char *colon = strrchr(address, ':');
+    int port;
+    if (!colon || (size_t)(colon - address) >= sizeof(host) ||
+        !cli_parse_int(colon + 1, &port) || port == 0 || port > 65535) {
+        fprintf(stderr, "connect: expected HOST:PORT, got %s\n", address);
+        return false;
+    }
+    memcpy(host, address, (size_t)(colon - address));
+    host[colon - address] = '\0';
+    spectate.fd = net_connect(host, port);
+    if (spectate.fd < 0) {
+        fprintf(stderr, "connect: could not reach %s\n", address);
+        return false;
+    }
+    spectate.active = true;
+    return true;
+}
+
+// Resume the game saved at save_path; false if there is none for this board
+static bool resume_game(void) {
+    gchar *data;
+    gsize size;
+    if (!g_file_get_contents(save_path, &data, &size, NULL)) return false;
+    TetrisSnapshot snapshot;
+    bool resumed = size == sizeof(snapshot.bytes);
+    if (resumed) {
+        memcpy(snapshot.bytes, data, sizeof(snapshot.bytes));
+        resumed = tetris_snapshot_restore(&game, &snapshot);
+    }
+    g_free(data);
+    if (!resumed) {
+        fprintf(stderr, "save: %s is not a saved %dx%d game, starting a new one\n", save_path,
+                BOARD_WIDTH, BOARD_HEIGHT);
+        return false;
+    }
+    game.paused = true;
+    if (report.ring) {
+        telemetry_game_start(report.ring, report.region.header->capacity, ++report.game, &game);
+    }
+    return true;
+}
+
+// Save the game for the next start, or drop the save once the game is over
+static void save_game(void) {
+    if (game.game_over) {
+        remove(save_path);
+        return;
+    }
+    TetrisSnapshot snapshot;
+    tetris_snapshot_save(&game, &snapshot);
+    GError *error = NULL;
+    if (!g_file_set_contents(save_path, (const gchar *)snapshot.bytes, sizeof(snapshot.bytes),
+                             &error)) {
+        fprintf(stderr, "save: %s\n", error->message);
+        g_error_free(error);
+    }
+}
+
+// Load a recording for --watch; the game starts from its seed
+static bool load_playback(const char *path) {
+    size_t size;
+    playback.data = replay_load_file(path, &size);
+    if (!playback.data || !replay_reader_init(&playback.reader, playback.data, size)) {
+        fprintf(stderr, "replay: could not load %s\n", path);
+        return false;
+    }
+    playback.active = true;
+    playback_fetch();
+    return true;
+}
+
 int main(int argc, char *argv[]) {
-    // Secure random seed initialization
-    struct timespec ts;
-    if (clock_gettime(CLOCK_REALTIME, &ts) == -1) {
-        srand(time(NULL));
-    } else {
-        srand(ts.tv_nsec);
+    CliOptions opts = {
+        .das_ms = DEFAULT_DAS_MS,
+        .arr_ms = DEFAULT_ARR_MS,
+        .preview = 1,
+    };
+    cli_select_board(argc, argv);
+    if (!cli_parse_options(&argc, argv, &opts)) {
+        cli_usage(argv[0]);
+        return 2;
+    }
+    next_seed = opts.seed;
+
+    int status = cli_run_headless(&opts);
+    if (status != CLI_NEEDS_WINDOW) return status;
+    if (opts.save && (opts.replay || opts.connect)) {
+        fprintf(stderr, "save: only games played in the window can be saved\n");
+        return 2;
     }
-    
+    if (opts.replay && !load_playback(opts.replay)) return 1;
+    if (opts.connect && !connect_spectator(opts.connect)) return 1;
+    record_path = opts.record;
+    save_path = opts.save;
+    randomizer = opts.randomizer;
+    preview_count = opts.preview;
+    if (opts.telemetry) {
+        if (!telemetry_create(&report.region, opts.telemetry, 1, 0)) {
+            fprintf(stderr, "telemetry: could not create segment %s\n", opts.telemetry);
+            return 1;
+        }
+        report.ring = telemetry_ring(&report.region, 0);
+    }
+
+    input.das_us = (gint64)opts.das_ms * 1000;
+    input.arr_us = (gint64)opts.arr_ms * 1000;
+
     gtk_init(&argc, &argv);
 
     GtkWidget *window = gtk_window_new(GTK_WINDOW_TOPLEVEL);
     gtk_window_set_title(GTK_WINDOW(window), "Tetris");
-    gtk_window_set_resizable(GTK_WINDOW(window), FALSE);
+    gtk_window_set_resizable(GTK_WINDOW(window), TRUE);
+    gtk_window_set_default_size(GTK_WINDOW(window),
+                                BOARD_WIDTH * BLOCK_SIZE + PREVIEW_SIZE * BLOCK_SIZE/2 + 5,
+                                BOARD_HEIGHT * BLOCK_SIZE);
     g_signal_connect(window, "destroy", G_CALLBACK(gtk_main_quit), NULL);
     g_signal_connect(window, "key-press-event", G_CALLBACK(key_press), NULL);
+    g_signal_connect(window, "key-release-event", G_CALLBACK(key_release), NULL);
+    g_signal_connect(window, "focus-out-event", G_CALLBACK(focus_out), NULL);
 
     GtkWidget *main_box = gtk_box_new(GTK_ORIENTATION_HORIZONTAL, 5);
     gtk_container_add(GTK_CONTAINER(window), main_box);
 
     widgets.drawing_area = gtk_drawing_area_new();
-    gtk_widget_set_size_request(widgets.drawing_area, 
-                              BOARD_WIDTH * BLOCK_SIZE, 
-                              BOARD_HEIGHT * BLOCK_SIZE);
-    gtk_box_pack_start(GTK_BOX(main_box), widgets.drawing_area, FALSE, FALSE, 0);
+    gtk_widget_set_size_request(widgets.drawing_area,
+                              BOARD_WIDTH * MIN_BLOCK_SIZE,
+                              BOARD_HEIGHT * MIN_BLOCK_SIZE);
+    gtk_box_pack_start(GTK_BOX(main_box), widgets.drawing_area, TRUE, TRUE, 0);
     g_signal_connect(widgets.drawing_area, "draw", G_CALLBACK(draw_callback), NULL);
+    g_signal_connect(widgets.drawing_area, "screen-changed", G_CALLBACK(drop_text_layouts), NULL);
+    g_signal_connect(widgets.drawing_area, "size-allocate", G_CALLBACK(board_allocated), NULL);
+    g_signal_connect(widgets.drawing_area, "realize", G_CALLBACK(board_realized), NULL);
+    redraw.board = cairo_region_create();
 
     GtkWidget *right_box = gtk_box_new(GTK_ORIENTATION_VERTICAL, 5);
     gtk_box_pack_start(GTK_BOX(main_box), right_box, FALSE, FALSE, 0);
 
     widgets.preview_area = gtk_drawing_area_new();
-    gtk_widget_set_size_request(widgets.preview_area, 
-                              PREVIEW_SIZE * BLOCK_SIZE/2, 
-                              PREVIEW_SIZE * BLOCK_SIZE/2);
+    gtk_widget_set_size_request(widgets.preview_area,
+                              PREVIEW_SIZE * BLOCK_SIZE/2,
+                              preview_count * PREVIEW_SIZE * BLOCK_SIZE/2);
     gtk_box_pack_start(GTK_BOX(right_box), widgets.preview_area, FALSE, FALSE, 0);
     g_signal_connect(widgets.preview_area, "draw", G_CALLBACK(draw_preview), NULL);
 
     widgets.new_game_button = gtk_button_new_with_label("New Game");
-    g_signal_connect(widgets.new_game_button, "clicked", 
+    g_signal_connect(widgets.new_game_button, "clicked",
                     G_CALLBACK(start_new_game), NULL);
     gtk_box_pack_start(GTK_BOX(right_box), widgets.new_game_button, FALSE, FALSE, 0);
 
     widgets.pause_button = gtk_button_new_with_label("Pause");
-    g_signal_connect(widgets.pause_button, "clicked", 
+    g_signal_connect(widgets.pause_button, "clicked",
                     G_CALLBACK(toggle_pause), NULL);
     gtk_box_pack_start(GTK_BOX(right_box), widgets.pause_button, FALSE, FALSE, 0);
 
     widgets.score_label = gtk_label_new("Score: 0  Level: 1");
     gtk_box_pack_start(GTK_BOX(right_box), widgets.score_label, FALSE, FALSE, 0);
 
-    init_game_state();
-    game.next_type = secure_rand(7);
-    new_piece();
-    game.timeout_id = g_timeout_add(game.game_speed, game_loop, NULL);
+    if (spectate.active) {
+        // Blank board until the server's snapshot arrives
+        tetris_init(&game, 0);
+        g_unix_fd_add(spectate.fd, G_IO_IN | G_IO_HUP | G_IO_ERR, spectate_readable, NULL);
+        gtk_widget_set_sensitive(widgets.new_game_button, FALSE);
+        gtk_widget_set_sensitive(widgets.pause_button, FALSE);
+    } else if (playback.active) {
+        tetris_init_randomizer(&game, playback.reader.info.seed,
+                               playback.reader.info.randomizer);
+    } else if (!save_path || !resume_game()) {
+        begin_game(next_seed++);
+    }
+    invalidate_board();
+    if (game.paused) {
+        gtk_button_set_label(GTK_BUTTON(widgets.pause_button), "Resume");
+    } else if (!spectate.active) {
+        start_clock();
+    }
 
     gtk_widget_show_all(window);
     gtk_main();
+    finish_recording();
+    if (save_path) save_game();
+    free(playback.data);
+    if (spectate.fd >= 0) spectate_close();
+    if (report.ring) telemetry_close(&report.region);
+
+    if (opts.profile_dump) {
+        prof_dump(stderr, &prof.frame);
+        prof_dump(stderr, &prof.tick);
+        prof_dump(stderr, &prof.lock);
+        prof_dump(stderr, &prof.draw);
+    }
 
     return 0;
 }
@@ -0,0 +1,243 @@
+#include "tetris_ai.h"
+
+#include <float.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "tetris_batch.h"
+
+const AiWeights ai_default_weights = {
+    .aggregate_height = -0.510066f,
+    .lines = 0.760666f,
+    .holes = -0.35663f,
+    .bumpiness = -0.184483f,
+};
+
+void ai_board_features(const GameState *game, AiFeatures *out) {
+    // O(width) over the engine's incrementally maintained column summaries
+    int aggregate = 0, holes = 0, bumpiness = 0;
+    for (int x = 0; x < BOARD_WIDTH; x++) {
+        aggregate += game->col_height[x];
+        holes += game->col_holes[x];
+    }
+    for (int x = 0; x + 1 < BOARD_WIDTH; x++) {
+        int d = game->col_height[x] - game->col_height[x + 1];
+        bumpiness += d < 0 ? -d : d;
+    }
+    out->aggregate_height = aggregate;
+    out->holes = holes;
+    out->bumpiness = bumpiness;
+}
+
+// Rotations and columns the falling piece can slide to, each with the row
+// it starts from rather than the one it lands on
+static int reachable(const GameState *game, AiMove *out) {
+    GameState probe = *game;
+    int count = 0;
+    // Square has one distinct rotation, I/S/Z have two
+    int distinct = game->current_type == 0 ? 1 : game->current_type <= 3 ? 2 : 4;
+
+    for (int r = 0; r < distinct; r++) {
+        if (r > 0 && !tetris_rotate(&probe)) break;
+        int type = probe.current_type, rotation = probe.current_rotation;
+        int y0 = probe.current_y;
+
+        // Columns reachable by sliding left and right from here
+        int lo = probe.current_x, hi = probe.current_x;
+        while (tetris_can_place(&probe, type, rotation, lo - 1, y0)) lo--;
+        while (tetris_can_place(&probe, type, rotation, hi + 1, y0)) hi++;
+
+        for (int x = lo; x <= hi; x++) {
+            out[count].rotation = rotation;
+            out[count].x = x;
+            out[count].y = y0;
+            out[count].score = 0.0f;
+            count++;
+        }
+    }
+    return count;
+}
+
+int ai_placements(const GameState *game, AiMove *out) {
+    int count = reachable(game, out);
+    for (int i = 0; i < count; i++) {
+        out[i].y = tetris_landing_row(game, game->current_type, out[i].rotation, out[i].x,
+                                      out[i].y);
+    }
+    return count;
+}
+
+// Land a placement on a scratch copy; returns lines cleared
+static int place(const GameState *game, const AiMove *move, GameState *scratch) {
+    memcpy(scratch, game, sizeof(*scratch));
+    scratch->current_rotation = move->rotation;
+    scratch->current_x = move->x;
+    scratch->current_y = move->y;
+    tetris_land_piece(scratch);
+    return tetris_clear_lines(scratch);
+}
+
+bool ai_cache_init(AiCache *cache, int bits) {
+    size_t count = (size_t)1 << bits;
+    cache->slots = calloc(count, sizeof(AiCacheSlot));
+    cache->mask = cache->slots ? count - 1 : 0;
+    return cache->slots != NULL;
+}
+
+void ai_cache_clear(AiCache *cache) {
+    memset(cache->slots, 0, (cache->mask + 1) * sizeof(AiCacheSlot));
+}
+
+void ai_cache_free(AiCache *cache) {
+    free(cache->slots);
+    cache->slots = NULL;
+    cache->mask = 0;
+}
+
+// Slot values pack the three features, 16 bits each
+static bool cache_probe(const AiCache *cache, uint64_t key, AiFeatures *f) {
+    const AiCacheSlot *slot = &cache->slots[key & cache->mask];
+    uint64_t value = atomic_load_explicit(&slot->value, memory_order_relaxed);
+    uint64_t check = atomic_load_explicit(&slot->check, memory_order_relaxed);
+    if (!key || (check ^ value) != key) return false;
+    f->aggregate_height = (int)(value & 0xffff);
+    f->holes = (int)((value >> 16) & 0xffff);
+    f->bumpiness = (int)((value >> 32) & 0xffff);
+    return true;
+}
+
+static void cache_store(AiCache *cache, uint64_t key, const AiFeatures *f) {
+    AiCacheSlot *slot = &cache->slots[key & cache->mask];
+    uint64_t value = (uint64_t)f->aggregate_height | (uint64_t)f->holes << 16 |
+                     (uint64_t)f->bumpiness << 32;
+    atomic_store_explicit(&slot->value, value, memory_order_relaxed);
+    atomic_store_explicit(&slot->check, key ^ value, memory_order_relaxed);
+}
+
+// board_hash after landing move, as long as it completes no row; clears
+// rehash the shifted rows, so those boards are always placed for real
+static bool predict_hash(const GameState *game, const AiMove *move, uint64_t *hash) {
+    const PieceRotation *piece = &piece_rotations[game->current_type][move->rotation];
+    uint64_t h = game->board_hash;
+    for (int r = 0; r < piece->height; r++) {
+        int y = move->y + r;
+        if (y < 0) continue;  // Above the board, like tetris_land_piece
+        uint16_t row = game->rows[y];
+        uint16_t filled = row | (uint16_t)(piece->row_mask[r] << move->x);
+        if (filled == FULL_ROW) return false;
+        h ^= tetris_row_key(y, row) ^ tetris_row_key(y, filled);
+    }
+    *hash = h;
+    return true;
+}
+
+// Best weighted leaf over the feature columns, in one branch-free pass
+static float best_leaf(const AiWeights *weights, int count, const float *height,
+                       const float *holes, const float *bump, const float *lines) {
+    float score = -FLT_MAX / 2;
+    for (int j = 0; j < count; j++) {
+        float s = weights->aggregate_height * height[j] +
+                  weights->lines * lines[j] +
+                  weights->holes * holes[j] +
+                  weights->bumpiness * bump[j];
+        score = s > score ? s : score;
+    }
+    return score;
+}
+
+// Second-ply leaves without a cache: every placement of the falling piece
+// dropped and scored BATCH_LANES at a time. Short batches repeat the first
+// placement so every lane holds a piece. Returns the placement count.
+static int batch_leaves(const GameState *game, int base_lines, AiMove *moves, float *height,
+                        float *holes, float *bump, float *lines) {
+    int count = reachable(game, moves);
+    BoardBatch batch;
+    BatchPieces pieces;
+    BatchFeatures f;
+    for (int base = 0; base < count; base += BATCH_LANES) {
+        int n = count - base < BATCH_LANES ? count - base : BATCH_LANES;
+        batch_load(&batch, game);
+        for (int l = 0; l < BATCH_LANES; l++) {
+            const AiMove *m = &moves[base + (l < n ? l : 0)];
+            batch_set_piece(&pieces, l, game->current_type, m->rotation, m->x, m->y);
+        }
+        batch_drop(&batch, &pieces);
+        batch_land(&batch, &pieces);
+        batch_evaluate(&batch, &f);
+        for (int l = 0; l < n; l++) {
+            moves[base + l].y = pieces.y[l];
+            height[base + l] = (float)f.aggregate_height[l];
+            holes[base + l] = (float)f.holes[l];
+            bump[base + l] = (float)f.bumpiness[l];
+            lines[base + l] = (float)(base_lines + f.lines[l]);
+        }
+    }
+    return count;
+}
+
+bool ai_best_move(const GameState *game, const AiWeights *weights, AiCache *cache,
+                  AiMove *out) {
+    AiMove first[AI_MAX_PLACEMENTS];
+    int first_count = ai_placements(game, first);
+    if (!first_count) return false;
+
+    GameState after_first, after_second;
+    AiMove second[AI_MAX_PLACEMENTS];
+    // Feature columns for the second ply, scored in one branch-free pass
+    float height[AI_MAX_PLACEMENTS], holes[AI_MAX_PLACEMENTS];
+    float bump[AI_MAX_PLACEMENTS], lines[AI_MAX_PLACEMENTS];
+
+    int best = 0;
+    float best_score = -FLT_MAX;
+    for (int i = 0; i < first_count; i++) {
+        int first_lines = place(game, &first[i], &after_first);
+
+        // Spawn the next piece the way the engine would
+        tetris_new_piece(&after_first);
+        float score;
+        if (!tetris_can_move(&after_first, 0, 0)) {
+            score = -FLT_MAX / 2;  // Tops out
+        } else if (!cache) {
+            int second_count = batch_leaves(&after_first, first_lines, second, height, holes,
+                                            bump, lines);
+            score = best_leaf(weights, second_count, height, holes, bump, lines);
+        } else {
+            int second_count = ai_placements(&after_first, second);
+            for (int j = 0; j < second_count; j++) {
+                // A hit yields exactly the features a real placement would,
+                // so scores and results do not depend on what is cached
+                AiFeatures f;
+                uint64_t key = 0;
+                int second_lines = 0;
+                bool predicted = predict_hash(&after_first, &second[j], &key);
+                if (!predicted || !cache_probe(cache, key, &f)) {
+                    second_lines = place(&after_first, &second[j], &after_second);
+                    ai_board_features(&after_second, &f);
+                    if (predicted) cache_store(cache, key, &f);
+                }
+                height[j] = (float)f.aggregate_height;
+                holes[j] = (float)f.holes;
+                bump[j] = (float)f.bumpiness;
+                lines[j] = (float)(first_lines + second_lines);
+            }
+            score = best_leaf(weights, second_count, height, holes, bump, lines);
+        }
+        first[i].score = score;
+        if (score > best_score) {
+            best_score = score;
+            best = i;
+        }
+    }
+    *out = first[best];
+    return true;
+}
+
+void ai_apply_move(GameState *game, const AiMove *move) {
+    for (int r = 0; r < 4 && game->current_rotation != move->rotation; r++) {
+        if (!tetris_rotate(game)) break;
+    }
+    int dx = move->x < game->current_x ? -1 : 1;
+    while (game->current_x != move->x) {
+        if (!tetris_move(game, dx, 0)) break;
+    }
+}
@@ -0,0 +1,81 @@
+#ifndef TETRIS_AI_H
+#define TETRIS_AI_H
+
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "tetris_engine.h"
+
+// Placement search for the autoplayer. Every reachable final placement
+// (rotation x column, then hard drop) of the current piece is tried on a
+// scratch copy of the board, followed by every placement of the next piece,
+// and the pair with the best heuristic score wins.
+
+#define AI_MAX_PLACEMENTS (4 * BOARD_WIDTH)
+
+// Heuristic weights; features are computed from column heights
+typedef struct {
+    float aggregate_height;
+    float lines;
+    float holes;
+    float bumpiness;
+} AiWeights;
+
+extern const AiWeights ai_default_weights;
+
+// A final resting position for the current piece
+typedef struct {
+    int rotation;
+    int x, y;
+    float score;
+} AiMove;
+
+// Board features of one position
+typedef struct {
+    int aggregate_height;
+    int holes;
+    int bumpiness;
+} AiFeatures;
+
+void ai_board_features(const GameState *game, AiFeatures *out) __attribute__((nonnull));
+
+// Enumerate the reachable placements of the falling piece; returns the count
+int ai_placements(const GameState *game, AiMove *out) __attribute__((nonnull));
+
+// Transposition table of second-ply leaf features keyed on board_hash. Two
+// orders of the same pair of pieces often leave the same board; a hit skips
+// landing the piece on a scratch copy. Slots are written without locks
+// (value and key ^ value), so searches on several threads can share one
+// table and a torn slot reads as a miss. Features do not depend on the
+// weights, so one table serves any number of weight sets. With only two
+// plies about 5% of leaves hit, which does not yet pay for the probes; it is
+// meant for deeper searches.
+typedef struct {
+    _Atomic uint64_t check;  // board_hash ^ value
+    _Atomic uint64_t value;
+} AiCacheSlot;
+
+typedef struct {
+    AiCacheSlot *slots;
+    uint64_t mask;
+} AiCache;
+
+#define AI_CACHE_DEFAULT_BITS 16
+
+// Allocate 2^bits slots; false if out of memory
+bool ai_cache_init(AiCache *cache, int bits) __attribute__((nonnull));
+void ai_cache_clear(AiCache *cache) __attribute__((nonnull));
+void ai_cache_free(AiCache *cache) __attribute__((nonnull));
+
+// Two-ply search over the current and next piece; false if nothing fits.
+// cache may be NULL, in which case the second ply runs on the batch kernels
+// of tetris_batch.h. Both paths choose the same moves.
+bool ai_best_move(const GameState *game, const AiWeights *weights, AiCache *cache,
+                  AiMove *out) __attribute__((nonnull(1, 2, 4)));
+
+// Rotate and shift the falling piece into the move's column; gravity or a
+// hard drop completes it
+void ai_apply_move(GameState *game, const AiMove *move) __attribute__((nonnull));
+
+#endif
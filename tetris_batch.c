@@ -0,0 +1,361 @@
+#include "tetris_batch.h"
+
+#include <stdbool.h>
+#include <string.h>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define BATCH_X86 1
+#elif defined(__ARM_NEON) && defined(__aarch64__)
+#include <arm_neon.h>
+#define BATCH_NEON 1
+#endif
+
+// Bit planes a column height needs; heights run 0..BOARD_HEIGHT
+#define PLANES (BOARD_HEIGHT < 16 ? 4 : BOARD_HEIGHT < 32 ? 5 : 6)
+// Columns that have a right-hand neighbour, for bumpiness
+#define INNER_COLUMNS ((uint16_t)(FULL_ROW >> 1))
+
+// The plane loops must unroll, or the planes live on the stack
+#define UNROLL _Pragma("GCC unroll 8")
+
+// One row of every lane, for the portable kernels. GCC and clang lower it
+// to whatever vector unit the baseline target has, or to plain integers.
+// Helpers take it by pointer, since 32-byte vectors pass differently with
+// and without AVX.
+typedef uint16_t Lanes __attribute__((vector_size(2 * BATCH_LANES)));
+typedef int16_t SignedLanes __attribute__((vector_size(2 * BATCH_LANES)));
+
+_Static_assert(sizeof(((BatchPieces *)0)->y) == 32, "y loads as one AVX2 vector");
+
+static inline Lanes *lanes(const uint16_t *row) {
+    return (Lanes *)row;
+}
+
+void batch_load(BoardBatch *batch, const GameState *game) {
+    for (int y = -BATCH_ABOVE; y < 0; y++) *lanes(batch_row(batch, y)) = (Lanes){0};
+    for (int y = 0; y < BOARD_HEIGHT; y++) {
+        *lanes(batch_row(batch, y)) = (Lanes){0} + game->rows[y];
+    }
+    for (int y = BOARD_HEIGHT; y < BOARD_HEIGHT + BATCH_BELOW; y++) {
+        *lanes(batch_row(batch, y)) = (Lanes){0} + 0xffff;
+    }
+}
+
+void batch_load_lane(BoardBatch *batch, int lane, const GameState *game) {
+    for (int y = -BATCH_ABOVE; y < BOARD_HEIGHT + BATCH_BELOW; y++) {
+        batch_row(batch, y)[lane] = y < 0 ? 0 : y < BOARD_HEIGHT ? game->rows[y] : 0xffff;
+    }
+}
+
+void batch_land(BoardBatch *batch, const BatchPieces *pieces) {
+    // The padding rows absorb box rows past the piece and cells above the board
+    for (int l = 0; l < BATCH_LANES; l++) {
+        uint16_t(*rows)[BATCH_LANES] = &batch->rows[BATCH_ABOVE + pieces->y[l]];
+        for (int r = 0; r < 4; r++) rows[r][l] |= pieces->mask[r][l];
+    }
+}
+
+// Portable kernels, the same steps as the AVX2 ones on the Lanes type
+
+static inline void popcount_lanes(Lanes *count, const Lanes *bits) {
+    Lanes v = *bits - ((*bits >> 1) & 0x5555);
+    v = (v & 0x3333) + ((v >> 2) & 0x3333);
+    v = (v + (v >> 4)) & 0x0f0f;
+    *count = (v + (v >> 8)) & 0x1f;
+}
+
+static inline bool all_set(const Lanes *v) {
+    uint64_t words[sizeof(Lanes) / 8];
+    memcpy(words, v, sizeof(words));
+    uint64_t all = ~(uint64_t)0;
+    for (size_t i = 0; i < sizeof(Lanes) / 8; i++) all &= words[i];
+    return all == ~(uint64_t)0;
+}
+
+static void drop_scalar(const BoardBatch *batch, BatchPieces *pieces) {
+    Lanes m0 = *lanes(pieces->mask[0]), m1 = *lanes(pieces->mask[1]);
+    Lanes m2 = *lanes(pieces->mask[2]), m3 = *lanes(pieces->mask[3]);
+    SignedLanes start;
+    memcpy(&start, pieces->y, sizeof(start));
+    int top = BOARD_HEIGHT;
+    for (int l = 0; l < BATCH_LANES; l++) top = pieces->y[l] < top ? pieces->y[l] : top;
+
+    SignedLanes land = start;
+    Lanes done = {0};
+    for (int y = top + 1; y < BOARD_HEIGHT; y++) {
+        const uint16_t(*rows)[BATCH_LANES] = &batch->rows[BATCH_ABOVE + y];
+        Lanes hit = (*lanes(rows[0]) & m0) | (*lanes(rows[1]) & m1) |
+                    (*lanes(rows[2]) & m2) | (*lanes(rows[3]) & m3);
+        Lanes moving = (Lanes)(start < (int16_t)y);
+        done |= moving & (Lanes)(hit != 0);
+        SignedLanes step = (SignedLanes)(moving & ~done);
+        land = (land & ~step) | (((SignedLanes){0} + (int16_t)y) & step);
+        if (all_set(&done)) break;
+    }
+    memcpy(pieces->y, &land, sizeof(land));
+}
+
+static void evaluate_scalar(const BoardBatch *batch, BatchFeatures *out) {
+    Lanes seen = {0}, cells = {0}, lines = {0};
+    Lanes planes[PLANES];
+    UNROLL for (int k = 0; k < PLANES; k++) planes[k] = (Lanes){0};
+    for (int y = 0; y < BOARD_HEIGHT; y++) {
+        Lanes row = *lanes(batch->rows[BATCH_ABOVE + y]);
+        // A full row is cleared and adds nothing; the rest stack up
+        Lanes cleared = (Lanes)(row == FULL_ROW);
+        Lanes kept = row & ~cleared;
+        lines -= cleared;
+        Lanes count;
+        popcount_lanes(&count, &kept);
+        cells += count;
+        seen |= kept;
+        // Every column topped out at or above this row grows by one
+        Lanes carry = seen & ~cleared;
+        UNROLL for (int k = 0; k < PLANES; k++) {
+            Lanes next = planes[k] & carry;
+            planes[k] ^= carry;
+            carry = next;
+        }
+    }
+
+    // Aggregate height is the weighted sum of the planes. Bumpiness
+    // subtracts them from themselves shifted one column over, then takes
+    // two's complement (~d + 1) of the columns that went negative.
+    Lanes aggregate = {0}, borrow = {0}, diff[PLANES];
+    UNROLL for (int k = 0; k < PLANES; k++) {
+        Lanes a = planes[k] & INNER_COLUMNS;
+        Lanes b = (planes[k] >> 1) & INNER_COLUMNS;
+        Lanes d = a ^ b;
+        diff[k] = d ^ borrow;
+        borrow = (~a & b) | (~d & borrow);
+        Lanes count;
+        popcount_lanes(&count, &planes[k]);
+        aggregate += count << k;
+    }
+    Lanes bumpiness = {0}, carry = borrow;
+    UNROLL for (int k = 0; k < PLANES; k++) {
+        Lanes e = diff[k] ^ borrow, sum = e ^ carry, count;
+        popcount_lanes(&count, &sum);
+        bumpiness += count << k;
+        carry &= e;
+    }
+    memcpy(out->lines, &lines, sizeof(lines));
+    memcpy(out->aggregate_height, &aggregate, sizeof(aggregate));
+    Lanes holes = aggregate - cells;
+    memcpy(out->holes, &holes, sizeof(holes));
+    memcpy(out->bumpiness, &bumpiness, sizeof(bumpiness));
+}
+
+#ifdef BATCH_X86
+
+#define AVX2 __attribute__((target("avx2")))
+
+static inline AVX2 __m256i load_avx2(const void *p) {
+    return _mm256_load_si256((const __m256i *)p);
+}
+
+// Per-lane popcount: nibble lookup, then the two byte counts of each lane summed
+static inline AVX2 __m256i popcount_avx2(__m256i v) {
+    const __m256i lut = _mm256_setr_epi8(0, 1, 1, 2, 1, 2, 2, 3, 1, 2, 2, 3, 2, 3, 3, 4,
+                                         0, 1, 1, 2, 1, 2, 2, 3, 1, 2, 2, 3, 2, 3, 3, 4);
+    const __m256i nibble = _mm256_set1_epi8(0x0f);
+    __m256i lo = _mm256_shuffle_epi8(lut, _mm256_and_si256(v, nibble));
+    __m256i hi = _mm256_shuffle_epi8(lut, _mm256_and_si256(_mm256_srli_epi16(v, 4), nibble));
+    return _mm256_maddubs_epi16(_mm256_add_epi8(lo, hi), _mm256_set1_epi8(1));
+}
+
+static AVX2 void drop_avx2(const BoardBatch *batch, BatchPieces *pieces) {
+    __m256i m0 = load_avx2(pieces->mask[0]), m1 = load_avx2(pieces->mask[1]);
+    __m256i m2 = load_avx2(pieces->mask[2]), m3 = load_avx2(pieces->mask[3]);
+    __m256i start = _mm256_loadu_si256((const __m256i *)pieces->y);
+    int top = BOARD_HEIGHT;
+    for (int l = 0; l < BATCH_LANES; l++) top = pieces->y[l] < top ? pieces->y[l] : top;
+
+    // Walk every lane down together; a lane stops at its first collision
+    // below its start and keeps the row above it
+    __m256i land = start, done = _mm256_setzero_si256();
+    for (int y = top + 1; y < BOARD_HEIGHT; y++) {
+        const uint16_t(*rows)[BATCH_LANES] = &batch->rows[BATCH_ABOVE + y];
+        __m256i hit = _mm256_or_si256(
+            _mm256_or_si256(_mm256_and_si256(load_avx2(rows[0]), m0),
+                            _mm256_and_si256(load_avx2(rows[1]), m1)),
+            _mm256_or_si256(_mm256_and_si256(load_avx2(rows[2]), m2),
+                            _mm256_and_si256(load_avx2(rows[3]), m3)));
+        __m256i row = _mm256_set1_epi16((short)y);
+        __m256i moving = _mm256_cmpgt_epi16(row, start);
+        __m256i blocked = _mm256_andnot_si256(_mm256_cmpeq_epi16(hit, _mm256_setzero_si256()),
+                                              moving);
+        done = _mm256_or_si256(done, blocked);
+        land = _mm256_blendv_epi8(land, row, _mm256_andnot_si256(done, moving));
+        if (_mm256_movemask_epi8(done) == -1) break;
+    }
+    _mm256_storeu_si256((__m256i *)pieces->y, land);
+}
+
+static AVX2 void evaluate_avx2(const BoardBatch *batch, BatchFeatures *out) {
+    const __m256i full = _mm256_set1_epi16((short)FULL_ROW);
+    __m256i seen = _mm256_setzero_si256(), cells = seen, lines = seen;
+    __m256i planes[PLANES];
+    UNROLL for (int k = 0; k < PLANES; k++) planes[k] = seen;
+    for (int y = 0; y < BOARD_HEIGHT; y++) {
+        __m256i row = load_avx2(batch->rows[BATCH_ABOVE + y]);
+        __m256i cleared = _mm256_cmpeq_epi16(row, full);
+        __m256i kept = _mm256_andnot_si256(cleared, row);
+        lines = _mm256_sub_epi16(lines, cleared);
+        cells = _mm256_add_epi16(cells, popcount_avx2(kept));
+        seen = _mm256_or_si256(seen, kept);
+        __m256i carry = _mm256_andnot_si256(cleared, seen);
+        UNROLL for (int k = 0; k < PLANES; k++) {
+            __m256i next = _mm256_and_si256(planes[k], carry);
+            planes[k] = _mm256_xor_si256(planes[k], carry);
+            carry = next;
+        }
+    }
+
+    // As in evaluate_scalar()
+    const __m256i inner = _mm256_set1_epi16((short)INNER_COLUMNS);
+    __m256i aggregate = _mm256_setzero_si256(), borrow = aggregate;
+    __m256i diff[PLANES];
+    UNROLL for (int k = 0; k < PLANES; k++) {
+        __m256i a = _mm256_and_si256(planes[k], inner);
+        __m256i b = _mm256_and_si256(_mm256_srli_epi16(planes[k], 1), inner);
+        __m256i d = _mm256_xor_si256(a, b);
+        diff[k] = _mm256_xor_si256(d, borrow);
+        borrow = _mm256_or_si256(_mm256_andnot_si256(a, b), _mm256_andnot_si256(d, borrow));
+        aggregate = _mm256_add_epi16(aggregate,
+                                     _mm256_sll_epi16(popcount_avx2(planes[k]),
+                                                      _mm_cvtsi32_si128(k)));
+    }
+    __m256i bumpiness = _mm256_setzero_si256(), carry = borrow;
+    UNROLL for (int k = 0; k < PLANES; k++) {
+        __m256i e = _mm256_xor_si256(diff[k], borrow);
+        bumpiness = _mm256_add_epi16(bumpiness,
+                                     _mm256_sll_epi16(popcount_avx2(_mm256_xor_si256(e, carry)),
+                                                      _mm_cvtsi32_si128(k)));
+        carry = _mm256_and_si256(carry, e);
+    }
+    _mm256_store_si256((__m256i *)out->lines, lines);
+    _mm256_storeu_si256((__m256i *)out->aggregate_height, aggregate);
+    _mm256_storeu_si256((__m256i *)out->holes, _mm256_sub_epi16(aggregate, cells));
+    _mm256_storeu_si256((__m256i *)out->bumpiness, bumpiness);
+}
+
+#endif
+
+#ifdef BATCH_NEON
+
+// Eight lanes per register, so every kernel runs over two halves
+
+static inline uint16x8_t popcount_neon(uint16x8_t v) {
+    return vpaddlq_u8(vcntq_u8(vreinterpretq_u8_u16(v)));
+}
+
+static void drop_neon(const BoardBatch *batch, BatchPieces *pieces) {
+    int top = BOARD_HEIGHT;
+    for (int l = 0; l < BATCH_LANES; l++) top = pieces->y[l] < top ? pieces->y[l] : top;
+    for (int h = 0; h < BATCH_LANES; h += 8) {
+        uint16x8_t m0 = vld1q_u16(&pieces->mask[0][h]), m1 = vld1q_u16(&pieces->mask[1][h]);
+        uint16x8_t m2 = vld1q_u16(&pieces->mask[2][h]), m3 = vld1q_u16(&pieces->mask[3][h]);
+        int16x8_t start = vld1q_s16(&pieces->y[h]);
+        int16x8_t land = start;
+        uint16x8_t done = vdupq_n_u16(0);
+        for (int y = top + 1; y < BOARD_HEIGHT; y++) {
+            const uint16_t(*rows)[BATCH_LANES] = &batch->rows[BATCH_ABOVE + y];
+            uint16x8_t hit = vorrq_u16(vorrq_u16(vandq_u16(vld1q_u16(&rows[0][h]), m0),
+                                                 vandq_u16(vld1q_u16(&rows[1][h]), m1)),
+                                       vorrq_u16(vandq_u16(vld1q_u16(&rows[2][h]), m2),
+                                                 vandq_u16(vld1q_u16(&rows[3][h]), m3)));
+            int16x8_t row = vdupq_n_s16((int16_t)y);
+            uint16x8_t moving = vcgtq_s16(row, start);
+            done = vorrq_u16(done, vandq_u16(vtstq_u16(hit, hit), moving));
+            land = vbslq_s16(vbicq_u16(moving, done), row, land);
+            if (vminvq_u16(done) == 0xffff) break;
+        }
+        vst1q_s16(&pieces->y[h], land);
+    }
+}
+
+static void evaluate_neon(const BoardBatch *batch, BatchFeatures *out) {
+    const uint16x8_t full = vdupq_n_u16(FULL_ROW);
+    const uint16x8_t inner = vdupq_n_u16(INNER_COLUMNS);
+    for (int h = 0; h < BATCH_LANES; h += 8) {
+        uint16x8_t seen = vdupq_n_u16(0), cells = seen, lines = seen;
+        uint16x8_t planes[PLANES];
+        UNROLL for (int k = 0; k < PLANES; k++) planes[k] = seen;
+        for (int y = 0; y < BOARD_HEIGHT; y++) {
+            uint16x8_t row = vld1q_u16(&batch->rows[BATCH_ABOVE + y][h]);
+            uint16x8_t cleared = vceqq_u16(row, full);
+            uint16x8_t kept = vbicq_u16(row, cleared);
+            lines = vsubq_u16(lines, cleared);
+            cells = vaddq_u16(cells, popcount_neon(kept));
+            seen = vorrq_u16(seen, kept);
+            uint16x8_t carry = vbicq_u16(seen, cleared);
+            UNROLL for (int k = 0; k < PLANES; k++) {
+                uint16x8_t next = vandq_u16(planes[k], carry);
+                planes[k] = veorq_u16(planes[k], carry);
+                carry = next;
+            }
+        }
+
+        uint16x8_t aggregate = vdupq_n_u16(0), borrow = aggregate;
+        uint16x8_t diff[PLANES];
+        UNROLL for (int k = 0; k < PLANES; k++) {
+            uint16x8_t a = vandq_u16(planes[k], inner);
+            uint16x8_t b = vandq_u16(vshrq_n_u16(planes[k], 1), inner);
+            uint16x8_t d = veorq_u16(a, b);
+            diff[k] = veorq_u16(d, borrow);
+            borrow = vorrq_u16(vbicq_u16(b, a), vbicq_u16(borrow, d));
+            aggregate = vaddq_u16(aggregate, vshlq_u16(popcount_neon(planes[k]),
+                                                       vdupq_n_s16((int16_t)k)));
+        }
+        uint16x8_t bumpiness = vdupq_n_u16(0), carry = borrow;
+        UNROLL for (int k = 0; k < PLANES; k++) {
+            uint16x8_t e = veorq_u16(diff[k], borrow);
+            bumpiness = vaddq_u16(bumpiness, vshlq_u16(popcount_neon(veorq_u16(e, carry)),
+                                                       vdupq_n_s16((int16_t)k)));
+            carry = vandq_u16(carry, e);
+        }
+        vst1q_u16(&out->lines[h], lines);
+        vst1q_u16(&out->aggregate_height[h], aggregate);
+        vst1q_u16(&out->holes[h], vsubq_u16(aggregate, cells));
+        vst1q_u16(&out->bumpiness[h], bumpiness);
+    }
+}
+
+#endif
+
+typedef struct {
+    const char *name;
+    void (*drop)(const BoardBatch *batch, BatchPieces *pieces);
+    void (*evaluate)(const BoardBatch *batch, BatchFeatures *out);
+} BatchKernel;
+
+static const BatchKernel scalar_kernel = {"scalar", drop_scalar, evaluate_scalar};
+static BatchKernel kernel = {"scalar", drop_scalar, evaluate_scalar};
+
+// Picked once before main, so the kernels never change under a running search
+__attribute__((constructor)) static void select_kernel(void) {
+#if defined(BATCH_X86)
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx2")) kernel = (BatchKernel){"avx2", drop_avx2, evaluate_avx2};
+#elif defined(BATCH_NEON)
+    kernel = (BatchKernel){"neon", drop_neon, evaluate_neon};
+#endif
+}
+
+void batch_drop(const BoardBatch *batch, BatchPieces *pieces) {
+    kernel.drop(batch, pieces);
+}
+
+void batch_evaluate(const BoardBatch *batch, BatchFeatures *out) {
+    kernel.evaluate(batch, out);
+}
+
+const char *batch_kernel(void) {
+    return kernel.name;
+}
+
+void batch_force_scalar(void) {
+    kernel = scalar_kernel;
+}
@@ -0,0 +1,81 @@
+#ifndef TETRIS_BATCH_H
+#define TETRIS_BATCH_H
+
+#include <stdint.h>
+
+#include "tetris_engine.h"
+
+// Structure-of-arrays kernels that drop pieces onto and score BATCH_LANES
+// boards at once, one board per SIMD lane. Row y of every board sits in one
+// 32-byte vector (rows[y][lane]), so collision tests, full-row checks and
+// the column features run lane-parallel. Column heights are kept bit-sliced
+// as the kernel walks down the rows: plane k holds bit k of the height of
+// every column, so heights and bumpiness come out of shifts and popcounts
+// instead of per-column loops.
+//
+// Kernels are AVX2 or NEON when the machine has them and portable C
+// otherwise; every kernel gives bit-identical results.
+
+#define BATCH_LANES 16
+#define BATCH_ABOVE 4  // Empty rows above the board, for pieces that start above it
+#define BATCH_BELOW 3  // Full rows below it, the floor a drop stops on
+
+typedef struct {
+    _Alignas(32) uint16_t rows[BATCH_ABOVE + BOARD_HEIGHT + BATCH_BELOW][BATCH_LANES];
+} BoardBatch;
+
+// One piece per lane: box rows already shifted to the piece's column (zero
+// past its height), and the box's top row
+typedef struct {
+    _Alignas(32) uint16_t mask[4][BATCH_LANES];
+    int16_t y[BATCH_LANES];
+} BatchPieces;
+
+// Per-lane results of batch_evaluate(): the features ai_board_features()
+// would report once full rows are cleared, plus how many were full
+typedef struct {
+    _Alignas(32) uint16_t lines[BATCH_LANES];
+    uint16_t aggregate_height[BATCH_LANES];
+    uint16_t holes[BATCH_LANES];
+    uint16_t bumpiness[BATCH_LANES];
+} BatchFeatures;
+
+static inline uint16_t *batch_row(BoardBatch *batch, int y) {
+    return batch->rows[BATCH_ABOVE + y];
+}
+
+// Copy game's board into every lane
+void batch_load(BoardBatch *batch, const GameState *game) __attribute__((nonnull));
+
+// Copy game's board into one lane
+void batch_load_lane(BoardBatch *batch, int lane, const GameState *game)
+    __attribute__((nonnull));
+
+// Put a piece in lane at (x, y); y may be as high as -BATCH_ABOVE. Every
+// lane needs a piece, so pad a short batch by repeating one.
+static inline void batch_set_piece(BatchPieces *pieces, int lane, int type, int rotation,
+                                   int x, int y) {
+    const PieceRotation *piece = &piece_rotations[type][rotation];
+    // row_mask is zero past the piece's height
+    for (int r = 0; r < 4; r++) pieces->mask[r][lane] = (uint16_t)(piece->row_mask[r] << x);
+    pieces->y[lane] = (int16_t)y;
+}
+
+// Lower every lane's piece from its y to the row it comes to rest on, like
+// tetris_landing_row(). Each piece must fit where it starts.
+void batch_drop(const BoardBatch *batch, BatchPieces *pieces) __attribute__((nonnull));
+
+// OR each lane's piece into its board at its y. Any cells above the board
+// go to the padding, which batch_load() resets.
+void batch_land(BoardBatch *batch, const BatchPieces *pieces) __attribute__((nonnull));
+
+// Count full rows and compute height, holes and bumpiness with them removed
+void batch_evaluate(const BoardBatch *batch, BatchFeatures *out) __attribute__((nonnull));
+
+// Kernel in use: "avx2", "neon" or "scalar"
+const char *batch_kernel(void);
+
+// Use the portable kernels whatever the machine has (for benchmarks)
+void batch_force_scalar(void);
+
+#endif
@@ -0,0 +1,336 @@
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "tetris_ai.h"
+#include "tetris_batch.h"
+#include "tetris_engine.h"
+#include "tetris_profile.h"
+#include "tetris_sim.h"
+
+// Microbenchmarks for the engine primitives. Every board corpus is generated
+// from a fixed seed, so numbers are comparable from commit to commit.
+
+#define CORPUS_SIZE 1024
+#define CORPUS_SEED 0x7e7215ULL
+#define DEFAULT_ROUNDS 2000
+#define DEFAULT_GAMES 20000
+#define SPAWN_ROWS 4  // Kept empty for the piece, which starts at row 0
+
+typedef struct {
+    GameState state;
+    int drop_y;  // Row the falling piece lands on
+} BenchBoard;
+
+static BenchBoard corpus[CORPUS_SIZE];
+static volatile uint64_t sink;  // Keeps results observable to the compiler
+
+// Fill the lower part of the board with a ragged stack that has at least one
+// gap per row, then make `full_rows` random rows of it full (fewer if the
+// stack is shorter, on small boards).
+static void build_corpus(int full_rows) {
+    TetrisRng rng;
+    tetris_rng_seed(&rng, CORPUS_SEED + (uint64_t)full_rows);
+    for (int n = 0; n < CORPUS_SIZE; n++) {
+        GameState *g = &corpus[n].state;
+        tetris_init(g, tetris_rng_next(&rng));
+        int top = BOARD_HEIGHT - 4 - tetris_rng_below(&rng, BOARD_HEIGHT / 2);
+        if (top < SPAWN_ROWS) top = SPAWN_ROWS;
+        for (int y = top; y < BOARD_HEIGHT; y++) {
+            uint16_t mask = (uint16_t)(tetris_rng_next(&rng) & FULL_ROW);
+            mask &= (uint16_t)~(1u << tetris_rng_below(&rng, BOARD_WIDTH));
+            g->rows[y] = mask;
+        }
+        for (int k = 0; k < full_rows && k < BOARD_HEIGHT - top; k++) {
+            int y;
+            do {
+                y = top + tetris_rng_below(&rng, BOARD_HEIGHT - top);
+            } while (g->rows[y] == FULL_ROW);
+            g->rows[y] = FULL_ROW;
+        }
+        for (int y = top; y < BOARD_HEIGHT; y++) {
+            for (int x = 0; x < BOARD_WIDTH; x++) {
+                if (g->rows[y] & (1u << x)) {
+                    g->colors[y] |= (TetrisColorRow)(1 + tetris_rng_below(&rng, TETROMINO_COUNT))
+                                    << (x * COLOR_BITS);
+                }
+            }
+        }
+        tetris_rebuild_features(g);
+        g->current_rotation = tetris_rng_below(&rng, 4);
+        const PieceRotation *piece = tetris_current_piece(g);
+        g->current_x = tetris_rng_below(&rng, BOARD_WIDTH - piece->width + 1);
+        g->current_y = 0;
+        int y = 0;
+        while (tetris_can_place(g, g->current_type, g->current_rotation,
+                                g->current_x, y + 1)) {
+            y++;
+        }
+        corpus[n].drop_y = y;
+    }
+}
+
+static void report(const char *name, uint64_t elapsed_ns, uint64_t ops) {
+    printf("%-24s %10.2f ns/op  (%llu ops)\n", name,
+           ops ? (double)elapsed_ns / (double)ops : 0.0, (unsigned long long)ops);
+}
+
+static void bench_can_move(int rounds) {
+    build_corpus(0);
+    uint64_t hits = 0;
+    uint64_t start = prof_now_ns();
+    for (int r = 0; r < rounds; r++) {
+        for (int n = 0; n < CORPUS_SIZE; n++) {
+            const GameState *g = &corpus[n].state;
+            hits += tetris_can_move(g, -1, 0);
+            hits += tetris_can_move(g, 1, 0);
+            hits += tetris_can_move(g, 0, 1);
+        }
+    }
+    uint64_t elapsed = prof_now_ns() - start;
+    sink += hits;
+    report("can_move", elapsed, (uint64_t)rounds * CORPUS_SIZE * 3);
+}
+
+// Time of copying a corpus board into scratch, subtracted from the
+// benchmarks below that need a fresh board per operation
+static uint64_t copy_baseline(int rounds) {
+    GameState scratch;
+    uint64_t start = prof_now_ns();
+    for (int r = 0; r < rounds; r++) {
+        for (int n = 0; n < CORPUS_SIZE; n++) {
+            memcpy(&scratch, &corpus[n].state, sizeof(scratch));
+            __asm__ volatile("" : : "r"(&scratch) : "memory");
+        }
+    }
+    return prof_now_ns() - start;
+}
+
+static void bench_land_piece(int rounds) {
+    build_corpus(0);
+    GameState scratch;
+    uint64_t baseline = copy_baseline(rounds);
+    uint64_t start = prof_now_ns();
+    for (int r = 0; r < rounds; r++) {
+        for (int n = 0; n < CORPUS_SIZE; n++) {
+            memcpy(&scratch, &corpus[n].state, sizeof(scratch));
+            scratch.current_y = corpus[n].drop_y;
+            tetris_land_piece(&scratch);
+            __asm__ volatile("" : : "r"(&scratch) : "memory");
+        }
+    }
+    uint64_t elapsed = prof_now_ns() - start;
+    sink += scratch.rows[BOARD_HEIGHT - 1];
+    report("land_piece", elapsed > baseline ? elapsed - baseline : 0,
+           (uint64_t)rounds * CORPUS_SIZE);
+}
+
+static void bench_clear_lines(int rounds, int full_rows) {
+    char name[32];
+    build_corpus(full_rows);
+    GameState scratch;
+    uint64_t lines = 0;
+    uint64_t baseline = copy_baseline(rounds);
+    uint64_t start = prof_now_ns();
+    for (int r = 0; r < rounds; r++) {
+        for (int n = 0; n < CORPUS_SIZE; n++) {
+            memcpy(&scratch, &corpus[n].state, sizeof(scratch));
+            lines += (uint64_t)tetris_clear_lines(&scratch);
+        }
+    }
+    uint64_t elapsed = prof_now_ns() - start;
+    sink += lines;
+    snprintf(name, sizeof(name), "clear_lines (%d full)", full_rows);
+    report(name, elapsed > baseline ? elapsed - baseline : 0,
+           (uint64_t)rounds * CORPUS_SIZE);
+}
+
+static void bench_rotate(int rounds) {
+    build_corpus(0);
+    uint64_t turned = 0;
+    uint64_t start = prof_now_ns();
+    for (int r = 0; r < rounds; r++) {
+        for (int n = 0; n < CORPUS_SIZE; n++) {
+            turned += tetris_rotate(&corpus[n].state);
+        }
+    }
+    uint64_t elapsed = prof_now_ns() - start;
+    sink += turned;
+    report("rotate", elapsed, (uint64_t)rounds * CORPUS_SIZE);
+}
+
+static void bench_new_piece(int rounds) {
+    build_corpus(0);
+    uint64_t start = prof_now_ns();
+    for (int r = 0; r < rounds; r++) {
+        for (int n = 0; n < CORPUS_SIZE; n++) {
+            tetris_new_piece(&corpus[n].state);
+        }
+    }
+    uint64_t elapsed = prof_now_ns() - start;
+    sink += (uint64_t)corpus[0].state.current_type;
+    report("new_piece", elapsed, (uint64_t)rounds * CORPUS_SIZE);
+}
+
+// Round trip through the snapshot blob, against copying the whole struct
+static void bench_snapshot(int rounds) {
+    build_corpus(0);
+    TetrisSnapshot snapshot;
+    GameState scratch;
+    uint64_t ok = 0;
+    uint64_t start = prof_now_ns();
+    for (int r = 0; r < rounds; r++) {
+        for (int n = 0; n < CORPUS_SIZE; n++) {
+            tetris_snapshot_save(&corpus[n].state, &snapshot);
+            ok += tetris_snapshot_restore(&scratch, &snapshot);
+        }
+    }
+    report("snapshot save+restore", prof_now_ns() - start, (uint64_t)rounds * CORPUS_SIZE);
+    if (ok != (uint64_t)rounds * CORPUS_SIZE) fprintf(stderr, "bench: snapshot rejected\n");
+
+    start = prof_now_ns();
+    for (int r = 0; r < rounds; r++) {
+        for (int n = 0; n < CORPUS_SIZE; n++) {
+            memcpy(&scratch, &corpus[n].state, sizeof(scratch));
+            ok += scratch.board_hash;
+        }
+    }
+    report("GameState copy", prof_now_ns() - start, (uint64_t)rounds * CORPUS_SIZE);
+    sink += ok;
+}
+
+// Every rotation and column of each board's piece that fits at the top
+typedef struct {
+    int8_t rotation, x;
+} BenchPlacement;
+
+static int leaf_placements(const GameState *g, BenchPlacement *out) {
+    int count = 0;
+    for (int r = 0; r < 4; r++) {
+        for (int x = 0; x < BOARD_WIDTH; x++) {
+            if (tetris_can_place(g, g->current_type, r, x, 0)) {
+                out[count++] = (BenchPlacement){(int8_t)r, (int8_t)x};
+            }
+        }
+    }
+    return count;
+}
+
+// Search leaves: drop, land, clear and score each placement, one at a time
+// on the engine and BATCH_LANES at a time on the batch kernels
+static void bench_leaves(int rounds) {
+    build_corpus(1);
+    rounds = (rounds + 19) / 20;
+    static BenchPlacement placements[CORPUS_SIZE][4 * BOARD_WIDTH];
+    static int counts[CORPUS_SIZE];
+    uint64_t leaves = 0, total = 0;
+    for (int n = 0; n < CORPUS_SIZE; n++) {
+        counts[n] = leaf_placements(&corpus[n].state, placements[n]);
+        leaves += (uint64_t)counts[n];
+    }
+    leaves *= (uint64_t)rounds;
+
+    GameState scratch;
+    AiFeatures f;
+    uint64_t start = prof_now_ns();
+    for (int r = 0; r < rounds; r++) {
+        for (int n = 0; n < CORPUS_SIZE; n++) {
+            const GameState *g = &corpus[n].state;
+            for (int i = 0; i < counts[n]; i++) {
+                const BenchPlacement *p = &placements[n][i];
+                memcpy(&scratch, g, sizeof(scratch));
+                scratch.current_rotation = p->rotation;
+                scratch.current_x = p->x;
+                scratch.current_y = tetris_landing_row(g, g->current_type, p->rotation, p->x, 0);
+                tetris_land_piece(&scratch);
+                total += (uint64_t)tetris_clear_lines(&scratch);
+                ai_board_features(&scratch, &f);
+                total += (uint64_t)(f.aggregate_height + f.holes + f.bumpiness);
+            }
+        }
+    }
+    report("leaves (engine)", prof_now_ns() - start, leaves);
+
+    for (int pass = 0; pass < 2; pass++) {
+        char name[32];
+        snprintf(name, sizeof(name), "leaves (batch %s)", batch_kernel());
+        BoardBatch batch;
+        BatchPieces pieces;
+        BatchFeatures out;
+        uint64_t batched = 0;
+        start = prof_now_ns();
+        for (int r = 0; r < rounds; r++) {
+            for (int n = 0; n < CORPUS_SIZE; n++) {
+                const GameState *g = &corpus[n].state;
+                for (int base = 0; base < counts[n]; base += BATCH_LANES) {
+                    int lanes = counts[n] - base < BATCH_LANES ? counts[n] - base : BATCH_LANES;
+                    batch_load(&batch, g);
+                    for (int l = 0; l < BATCH_LANES; l++) {
+                        const BenchPlacement *p = &placements[n][base + (l < lanes ? l : 0)];
+                        batch_set_piece(&pieces, l, g->current_type, p->rotation, p->x, 0);
+                    }
+                    batch_drop(&batch, &pieces);
+                    batch_land(&batch, &pieces);
+                    batch_evaluate(&batch, &out);
+                    for (int l = 0; l < lanes; l++) {
+                        batched += (uint64_t)(out.lines[l] + out.aggregate_height[l] +
+                                              out.holes[l] + out.bumpiness[l]);
+                    }
+                }
+            }
+        }
+        report(name, prof_now_ns() - start, leaves);
+        // Both paths must agree on every leaf
+        if (batched != total) fprintf(stderr, "bench: %s disagrees with the engine\n", name);
+        if (strcmp(batch_kernel(), "scalar") == 0) break;
+        batch_force_scalar();
+    }
+    sink += total;
+}
+
+static void bench_games(int games) {
+    SimConfig config = {
+        .games = games,
+        .threads = 1,
+        .seed = CORPUS_SEED,
+    };
+    SimResult result;
+    if (sim_run(&config, &result) != 0) {
+        fprintf(stderr, "bench: could not start simulator\n");
+        return;
+    }
+    printf("%-24s %10.0f games/s  (%d games, %llu pieces, %.0f ns/piece)\n",
+           "headless game", result.seconds > 0 ? result.games / result.seconds : 0.0,
+           result.games, (unsigned long long)result.total_pieces,
+           result.total_pieces ? result.seconds * 1e9 / (double)result.total_pieces : 0.0);
+}
+
+int main(int argc, char *argv[]) {
+    int rounds = DEFAULT_ROUNDS;
+    int games = DEFAULT_GAMES;
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "--rounds") == 0 && i + 1 < argc) {
+            rounds = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "--games") == 0 && i + 1 < argc) {
+            games = atoi(argv[++i]);
+        } else {
+            fprintf(stderr, "usage: %s [--rounds N] [--games N]\n", argv[0]);
+            return 2;
+        }
+    }
+    if (rounds < 1) rounds = 1;
+
+    printf("corpus: %d boards, seed 0x%llx, %d rounds\n", CORPUS_SIZE,
+           (unsigned long long)CORPUS_SEED, rounds);
+    bench_can_move(rounds);
+    bench_land_piece(rounds);
+    for (int k = 0; k <= 4; k++) bench_clear_lines(rounds, k);
+    bench_rotate(rounds);
+    bench_new_piece(rounds);
+    bench_snapshot(rounds);
+    bench_leaves(rounds);
+    if (games > 0) bench_games(games);
+    return 0;
+}
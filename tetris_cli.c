@@ -0,0 +1,349 @@
+#include "tetris_cli.h"
+
+#include <errno.h>
+#include <limits.h>
+#include <stdatomic.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "tetris_corpus.h"
+#include "tetris_net.h"
+#include "tetris_profile.h"
+#include "tetris_replay.h"
+#include "tetris_sim.h"
+#include "tetris_telemetry.h"
+
+void cli_select_board(int argc, char **argv) {
+    for (int i = 1; i + 1 < argc; i++) {
+        int width, height;
+        char end;
+        if (strcmp(argv[i], "--board") != 0 ||
+            sscanf(argv[i + 1], "%dx%d%c", &width, &height, &end) != 2 ||
+            (width == BOARD_WIDTH && height == BOARD_HEIGHT)) {
+            continue;
+        }
+        char self[PATH_MAX], variant[PATH_MAX + 32], suffix[32];
+        ssize_t len = readlink("/proc/self/exe", self, sizeof(self) - 1);
+        if (len <= 0) exit(1);
+        self[len] = '\0';
+        // Strip our own size suffix to get the base name
+        snprintf(suffix, sizeof(suffix), "-%dx%d", BOARD_WIDTH, BOARD_HEIGHT);
+        size_t base = strlen(self), suffix_len = strlen(suffix);
+        if (base > suffix_len && strcmp(self + base - suffix_len, suffix) == 0) {
+            self[base - suffix_len] = '\0';
+        }
+        snprintf(variant, sizeof(variant), "%s-%dx%d", self, width, height);
+        execv(variant, argv);
+        if (width == 10 && height == 20) execv(self, argv);  // The default build
+        fprintf(stderr, "board: no %dx%d build next to %s (%s)\n", width, height, self,
+                strerror(errno));
+        exit(1);
+    }
+}
+
+bool cli_parse_int(const char *arg, int *out) {
+    char *end;
+    long value = strtol(arg, &end, 10);
+    if (*arg == '\0' || *end != '\0' || value < 0 || value > INT_MAX) return false;
+    *out = (int)value;
+    return true;
+}
+
+static bool parse_randomizer(const char *arg, TetrisRandomizer *out) {
+    static const char *names[TETRIS_RANDOMIZER_COUNT] = {
+        [TETRIS_RANDOMIZER_UNIFORM] = "uniform",
+        [TETRIS_RANDOMIZER_BAG] = "bag",
+        [TETRIS_RANDOMIZER_HISTORY] = "history",
+    };
+    for (int i = 0; i < TETRIS_RANDOMIZER_COUNT; i++) {
+        if (strcmp(arg, names[i]) == 0) {
+            *out = (TetrisRandomizer)i;
+            return true;
+        }
+    }
+    return false;
+}
+
+bool cli_parse_options(int *argc, char **argv, CliOptions *opts) {
+    int out = 1;
+    for (int i = 1; i < *argc; i++) {
+        const char *arg = argv[i];
+        bool has_value = i + 1 < *argc;
+        if (strcmp(arg, "--simulate") == 0 && has_value) {
+            if (!cli_parse_int(argv[++i], &opts->simulate)) return false;
+        } else if (strcmp(arg, "--threads") == 0 && has_value) {
+            if (!cli_parse_int(argv[++i], &opts->threads)) return false;
+        } else if (strcmp(arg, "--versus") == 0) {
+            opts->versus = true;
+        } else if (strcmp(arg, "--ai") == 0) {
+            opts->ai = true;
+        } else if (strcmp(arg, "--max-pieces") == 0 && has_value) {
+            if (!cli_parse_int(argv[++i], &opts->max_pieces)) return false;
+        } else if (strcmp(arg, "--das") == 0 && has_value) {
+            if (!cli_parse_int(argv[++i], &opts->das_ms)) return false;
+        } else if (strcmp(arg, "--arr") == 0 && has_value) {
+            if (!cli_parse_int(argv[++i], &opts->arr_ms)) return false;
+        } else if (strcmp(arg, "--profile-dump") == 0) {
+            opts->profile_dump = true;
+        } else if (strcmp(arg, "--randomizer") == 0 && has_value) {
+            if (!parse_randomizer(argv[++i], &opts->randomizer)) return false;
+        } else if (strcmp(arg, "--preview") == 0 && has_value) {
+            if (!cli_parse_int(argv[++i], &opts->preview) || opts->preview < 1 ||
+                opts->preview > PREVIEW_DEPTH) {
+                return false;
+            }
+        } else if (strcmp(arg, "--record") == 0 && has_value) {
+            opts->record = argv[++i];
+        } else if (strcmp(arg, "--save") == 0 && has_value) {
+            opts->save = argv[++i];
+        } else if (strcmp(arg, "--replay") == 0 && has_value) {
+            opts->replay = argv[++i];
+        } else if (strcmp(arg, "--watch") == 0) {
+            opts->watch = true;
+        } else if (strcmp(arg, "--record-corpus") == 0 && has_value) {
+            opts->record_corpus = argv[++i];
+        } else if (strcmp(arg, "--verify-corpus") == 0 && has_value) {
+            opts->verify_corpus = argv[++i];
+        } else if (strcmp(arg, "--serve") == 0 && has_value) {
+            if (!cli_parse_int(argv[++i], &opts->serve) || opts->serve == 0 ||
+                opts->serve > 65535) {
+                return false;
+            }
+        } else if (strcmp(arg, "--connect") == 0 && has_value) {
+            opts->connect = argv[++i];
+        } else if (strcmp(arg, "--board") == 0 && has_value) {
+            // select_board already switched to the build for the size
+            int width, height;
+            char end;
+            if (sscanf(argv[++i], "%dx%d%c", &width, &height, &end) != 2 ||
+                width != BOARD_WIDTH || height != BOARD_HEIGHT) {
+                return false;
+            }
+        } else if (strcmp(arg, "--telemetry") == 0 && has_value) {
+            opts->telemetry = argv[++i];
+        } else if (strcmp(arg, "--scrape") == 0 && has_value) {
+            opts->scrape = argv[++i];
+        } else if (strcmp(arg, "--headless") == 0) {
+            opts->headless = true;
+        } else if (strcmp(arg, "--seed") == 0 && has_value) {
+            char *end;
+            opts->seed = strtoull(argv[++i], &end, 0);
+            if (*end != '\0') return false;
+            opts->have_seed = true;
+        } else {
+            argv[out++] = argv[i];
+        }
+    }
+    *argc = out;
+    argv[out] = NULL;
+
+    // Secure random seed initialization
+    if (!opts->have_seed) {
+        struct timespec ts;
+        if (clock_gettime(CLOCK_REALTIME, &ts) == -1) {
+            opts->seed = (uint64_t)time(NULL);
+        } else {
+            opts->seed = ((uint64_t)ts.tv_sec << 32) ^ (uint64_t)ts.tv_nsec;
+        }
+    }
+    return true;
+}
+
+void cli_usage(const char *argv0) {
+    fprintf(stderr, "usage: %s [--simulate N [--threads T] [--ai] [--max-pieces N] [--versus]\n"
+            "       [--record-corpus FILE]] [--verify-corpus FILE [--threads T]]\n"
+            "       [--seed S] [--das MS] [--arr MS] [--profile-dump]\n"
+            "       [--record FILE | --replay FILE [--watch]] [--save FILE]\n"
+            "       [--randomizer uniform|bag|history] [--preview N]\n"
+            "       [--serve PORT | --connect HOST:PORT]\n"
+            "       [--telemetry NAME | --scrape NAME] [--board WxH] [--headless]\n", argv0);
+}
+
+static int run_simulation(const CliOptions *opts) {
+    SimConfig config = {
+        .games = opts->simulate,
+        .threads = opts->threads,
+        .seed = opts->seed,
+        .max_pieces = opts->max_pieces,
+        .randomizer = opts->randomizer,
+        .policy = opts->ai ? sim_ai_policy : sim_random_policy,
+        .versus = opts->versus,
+    };
+    if (opts->record_corpus && opts->versus) {
+        fprintf(stderr, "simulation: versus matches cannot be recorded to a corpus\n");
+        return 1;
+    }
+    Telemetry telemetry;
+    if (opts->telemetry) {
+        uint32_t rings = (uint32_t)sim_thread_count(opts->threads, (uint32_t)opts->simulate);
+        if (!telemetry_create(&telemetry, opts->telemetry, rings, 0)) {
+            fprintf(stderr, "simulation: could not create telemetry segment %s\n",
+                    opts->telemetry);
+            return 1;
+        }
+        config.telemetry = &telemetry;
+    }
+    CorpusWriter corpus;
+    if (opts->record_corpus) {
+        if (!corpus_writer_open(&corpus, opts->record_corpus, (uint32_t)opts->simulate)) {
+            fprintf(stderr, "simulation: could not create %s\n", opts->record_corpus);
+            if (config.telemetry) telemetry_close(config.telemetry);
+            return 1;
+        }
+        config.corpus = &corpus;
+    }
+    SimResult result;
+    int status = sim_run(&config, &result);
+    if (config.telemetry) telemetry_close(config.telemetry);
+    if (config.corpus && !corpus_writer_close(&corpus)) {
+        fprintf(stderr, "simulation: could not write %s\n", opts->record_corpus);
+        return 1;
+    }
+    if (status != 0) {
+        fprintf(stderr, "simulation: could not start worker threads\n");
+        return 1;
+    }
+    // Means are per player; a versus match has two
+    double players = result.games ? (double)result.games * (opts->versus ? 2 : 1) : 1.0;
+    printf("games: %d  threads: %d  seed: %llu\n", result.games, result.threads,
+           (unsigned long long)opts->seed);
+    printf("score: total %llu  mean %.1f  best %d\n",
+           (unsigned long long)result.total_score, result.total_score / players,
+           result.best_score);
+    printf("lines: total %llu  mean %.2f\n",
+           (unsigned long long)result.total_lines, result.total_lines / players);
+    printf("pieces: total %llu\n", (unsigned long long)result.total_pieces);
+    if (opts->versus) {
+        printf("wins: player 1 %d  player 2 %d  unfinished %d\n", result.wins[0],
+               result.wins[1], result.games - result.wins[0] - result.wins[1]);
+    }
+    printf("elapsed: %.3f s  %.0f games/s\n", result.seconds,
+           result.seconds > 0 ? result.games / result.seconds : 0.0);
+    return 0;
+}
+
+static int run_verify(const CliOptions *opts) {
+    Corpus corpus;
+    if (!corpus_open(&corpus, opts->verify_corpus)) {
+        fprintf(stderr, "verify: %s is not a readable corpus\n", opts->verify_corpus);
+        return 1;
+    }
+    CorpusReport report;
+    int status = corpus_verify(&corpus, opts->threads, &report);
+    corpus_close(&corpus);
+    if (status != 0) {
+        fprintf(stderr, "verify: could not start worker threads\n");
+        return 1;
+    }
+    printf("games: %u  threads: %d  inputs: %llu\n", report.games, report.threads,
+           (unsigned long long)report.total_inputs);
+    printf("passed: %u  mismatched: %u  corrupt: %u\n", report.passed,
+           report.mismatched, report.corrupt);
+    printf("elapsed: %.3f s  %.0f games/s\n", report.seconds,
+           report.seconds > 0 ? report.games / report.seconds : 0.0);
+    if (report.passed != report.games) {
+        fprintf(stderr, "verify: first failing game is #%u\n", report.first_failure);
+        return 1;
+    }
+    return 0;
+}
+
+// Re-simulate a recording at full speed and check it ends as recorded
+static int run_replay(const CliOptions *opts) {
+    size_t size;
+    uint8_t *data = replay_load_file(opts->replay, &size);
+    if (!data) {
+        fprintf(stderr, "replay: could not read %s\n", opts->replay);
+        return 1;
+    }
+    GameState replayed;
+    ReplayInfo info;
+    uint64_t start = prof_now_ns();
+    ReplayStatus status = replay_run(data, size, &replayed, &info);
+    double seconds = (double)(prof_now_ns() - start) / 1e9;
+    free(data);
+
+    if (status == REPLAY_CORRUPT) {
+        fprintf(stderr, "replay: %s is not a valid recording\n", opts->replay);
+        return 1;
+    }
+    printf("seed: %llu  inputs: %zu  ticks: %u  bytes: %zu\n",
+           (unsigned long long)info.seed, info.inputs, info.ticks, size);
+    printf("score: %d  lines: %d  pieces: %d\n", replayed.score, replayed.lines,
+           replayed.pieces);
+    printf("elapsed: %.6f s\n", seconds);
+    if (status == REPLAY_MISMATCH) {
+        fprintf(stderr, "replay: diverged, recorded score %d lines %d pieces %d\n",
+                info.score, info.lines, info.pieces);
+        return 1;
+    }
+    return 0;
+}
+
+// Print one line per ring every second: events drained since the last
+// line, drops, and lock/placement latency so far. Runs until interrupted.
+static int run_scrape(const CliOptions *opts) {
+    Telemetry telemetry;
+    if (!telemetry_attach(&telemetry, opts->scrape)) {
+        fprintf(stderr, "scrape: %s is not a telemetry segment\n", opts->scrape);
+        return 1;
+    }
+    uint32_t capacity = telemetry.header->capacity;
+    TelemetryEvent events[256];
+    ProfHistogram lock = {.name = "lock"}, place = {.name = "place"};
+    for (;;) {
+        for (uint32_t r = 0; r < telemetry.header->ring_count; r++) {
+            TelemetryRing *ring = telemetry_ring(&telemetry, r);
+            uint64_t kinds[TELEMETRY_GAME_OVER + 1] = {0}, lines = 0;
+            size_t n;
+            while ((n = telemetry_poll(ring, capacity, events, 256)) > 0) {
+                for (size_t i = 0; i < n; i++) {
+                    if (events[i].kind <= TELEMETRY_GAME_OVER) kinds[events[i].kind]++;
+                    if (events[i].kind == TELEMETRY_LINES) lines += events[i].arg;
+                }
+            }
+            telemetry_read_latency(&ring->lock, &lock);
+            telemetry_read_latency(&ring->place, &place);
+            printf("ring %u: games %llu  pieces %llu  lines %llu  levels %llu  over %llu"
+                   "  dropped %llu  lock p50 %llu p99 %llu ns  place p50 %llu p99 %llu ns\n", r,
+                   (unsigned long long)kinds[TELEMETRY_GAME_START],
+                   (unsigned long long)kinds[TELEMETRY_SPAWN], (unsigned long long)lines,
+                   (unsigned long long)kinds[TELEMETRY_LEVEL_UP],
+                   (unsigned long long)kinds[TELEMETRY_GAME_OVER],
+                   (unsigned long long)atomic_load(&ring->dropped),
+                   (unsigned long long)prof_percentile(&lock, 0.50),
+                   (unsigned long long)prof_percentile(&lock, 0.99),
+                   (unsigned long long)prof_percentile(&place, 0.50),
+                   (unsigned long long)prof_percentile(&place, 0.99));
+        }
+        fflush(stdout);
+        sleep(1);
+    }
+}
+
+// Autoplay games forever and stream them to every --connect client
+static int run_serve(const CliOptions *opts) {
+    NetServerConfig config = {
+        .port = opts->serve,
+        .seed = opts->seed,
+        .randomizer = opts->randomizer,
+        .tick_ms = NET_DEFAULT_TICK_MS,
+    };
+    return net_serve(&config);
+}
+
+int cli_run_headless(const CliOptions *opts) {
+    if (opts->simulate > 0) return run_simulation(opts);
+    if (opts->verify_corpus) return run_verify(opts);
+    if (opts->replay && !opts->watch) return run_replay(opts);
+    if (opts->scrape) return run_scrape(opts);
+    if (opts->serve) return run_serve(opts);
+    if (opts->headless) {
+        fprintf(stderr, "headless: these options need the window\n");
+        return 2;
+    }
+    return CLI_NEEDS_WINDOW;
+}
@@ -0,0 +1,62 @@
+#ifndef TETRIS_CLI_H
+#define TETRIS_CLI_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "tetris_engine.h"
+
+// The command line shared by gtktetris and tetris-headless, and every mode
+// that runs without a window: simulation, corpus checks, headless replay,
+// telemetry scraping and the spectator server. Nothing here touches GTK, so
+// tetris-headless links without it and starts without loading the toolkit.
+
+typedef struct {
+    int simulate;   // Number of headless games, 0 for the GUI
+    int threads;
+    bool ai;        // Simulate with the placement search instead of random moves
+    int max_pieces;
+    uint64_t seed;
+    bool have_seed;
+    int das_ms, arr_ms;
+    bool profile_dump;
+    TetrisRandomizer randomizer;
+    int preview;
+    const char *record;  // Record GUI games to this file
+    const char *save;    // Resume the GUI game saved here, and save it on exit
+    const char *replay;  // Replay this file headless, or in the GUI with watch
+    bool watch;
+    const char *record_corpus;  // Write the simulated games to this corpus
+    const char *verify_corpus;  // Re-simulate and check every game in this corpus
+    bool versus;                // Simulate two-player matches trading garbage
+    int serve;                  // Port to stream autoplayed games on, 0 for none
+    const char *connect;        // HOST:PORT of a server to spectate
+    const char *telemetry;      // Shared-memory segment to export telemetry to
+    const char *scrape;         // Segment to read telemetry from
+    bool headless;              // Fail instead of opening a window
+} CliOptions;
+
+// cli_run_headless() result when the options describe a windowed session
+#define CLI_NEEDS_WINDOW (-1)
+
+// --board WxH. Each board size is its own build, so the hot paths see
+// constant dimensions (build the wide one with -DBOARD_WIDTH=16
+// -DBOARD_HEIGHT=24 and a -16x24 suffix, like gtktetris-16x24). A build
+// asked for another size re-executes its sibling for that size with the
+// same arguments, and only returns if it already is the right one.
+void cli_select_board(int argc, char **argv) __attribute__((nonnull));
+
+// Consume our own flags and compact argv so gtk_init only sees the rest.
+// Fills in a time-based seed when none was given; false on a bad option.
+bool cli_parse_options(int *argc, char **argv, CliOptions *opts) __attribute__((nonnull));
+
+void cli_usage(const char *argv0) __attribute__((nonnull));
+
+// Non-negative decimal int; false if arg is anything else
+bool cli_parse_int(const char *arg, int *out) __attribute__((nonnull));
+
+// Run the headless mode opts select and return its exit status, or
+// CLI_NEEDS_WINDOW if they select none and --headless was not given
+int cli_run_headless(const CliOptions *opts) __attribute__((nonnull));
+
+#endif
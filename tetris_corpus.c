@@ -0,0 +1,232 @@
+#include "tetris_corpus.h"
+
+#include <fcntl.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "tetris_replay.h"
+#include "tetris_sim.h"
+
+static const uint8_t corpus_magic[4] = {'T', 'T', 'R', 'C'};
+
+static void put_le(uint8_t *out, uint64_t value, int bytes) {
+    for (int i = 0; i < bytes; i++) out[i] = (uint8_t)(value >> (8 * i));
+}
+
+static uint64_t get_le(const uint8_t *in, int bytes) {
+    uint64_t value = 0;
+    for (int i = 0; i < bytes; i++) value |= (uint64_t)in[i] << (8 * i);
+    return value;
+}
+
+static void encode_header(uint8_t *out, uint32_t count, uint64_t index_offset) {
+    memset(out, 0, CORPUS_HEADER_SIZE);
+    memcpy(out, corpus_magic, sizeof(corpus_magic));
+    out[4] = CORPUS_VERSION;
+    put_le(out + 8, count, 4);
+    put_le(out + 16, index_offset, 8);
+}
+
+bool corpus_writer_open(CorpusWriter *writer, const char *path, uint32_t count) {
+    memset(writer, 0, sizeof(*writer));
+    writer->entries = calloc(count ? count : 1, sizeof(CorpusEntry));
+    if (!writer->entries) return false;
+    writer->file = fopen(path, "wb");
+    if (!writer->file) {
+        free(writer->entries);
+        return false;
+    }
+    pthread_mutex_init(&writer->lock, NULL);
+    writer->count = count;
+
+    // Placeholder until the index offset is known
+    uint8_t header[CORPUS_HEADER_SIZE];
+    encode_header(header, count, 0);
+    writer->failed = fwrite(header, 1, sizeof(header), writer->file) != sizeof(header);
+    writer->offset = CORPUS_HEADER_SIZE;
+    return true;
+}
+
+void corpus_writer_add(CorpusWriter *writer, uint32_t index, const uint8_t *replay,
+                       size_t size, const GameState *game) {
+    uint64_t board_hash = replay_board_hash(game);
+    pthread_mutex_lock(&writer->lock);
+    if (index >= writer->count || !replay || size == 0 || size > UINT32_MAX) {
+        writer->failed = true;
+        pthread_mutex_unlock(&writer->lock);
+        return;
+    }
+    CorpusEntry *entry = &writer->entries[index];
+    entry->size = (uint32_t)size;
+    entry->score = game->score;
+    entry->board_hash = board_hash;
+    entry->offset = writer->offset;
+    if (fwrite(replay, 1, size, writer->file) != size) writer->failed = true;
+    writer->offset += size;
+    pthread_mutex_unlock(&writer->lock);
+}
+
+bool corpus_writer_close(CorpusWriter *writer) {
+    uint64_t index_offset = writer->offset;
+    for (uint32_t i = 0; i < writer->count; i++) {
+        const CorpusEntry *entry = &writer->entries[i];
+        uint8_t record[CORPUS_ENTRY_SIZE];
+        if (entry->size == 0) writer->failed = true;
+        put_le(record, entry->offset, 8);
+        put_le(record + 8, entry->size, 4);
+        put_le(record + 12, (uint32_t)entry->score, 4);
+        put_le(record + 16, entry->board_hash, 8);
+        if (fwrite(record, 1, sizeof(record), writer->file) != sizeof(record)) {
+            writer->failed = true;
+        }
+    }
+    uint8_t header[CORPUS_HEADER_SIZE];
+    encode_header(header, writer->count, index_offset);
+    if (fseek(writer->file, 0, SEEK_SET) != 0 ||
+        fwrite(header, 1, sizeof(header), writer->file) != sizeof(header)) {
+        writer->failed = true;
+    }
+    if (fclose(writer->file) != 0) writer->failed = true;
+    pthread_mutex_destroy(&writer->lock);
+    free(writer->entries);
+    writer->file = NULL;
+    writer->entries = NULL;
+    return !writer->failed;
+}
+
+void corpus_entry(const Corpus *corpus, uint32_t i, CorpusEntry *entry,
+                  const uint8_t **replay) {
+    const uint8_t *record = corpus->index + (size_t)i * CORPUS_ENTRY_SIZE;
+    entry->offset = get_le(record, 8);
+    entry->size = (uint32_t)get_le(record + 8, 4);
+    entry->score = (int)(uint32_t)get_le(record + 12, 4);
+    entry->board_hash = get_le(record + 16, 8);
+    *replay = corpus->map + entry->offset;
+}
+
+bool corpus_open(Corpus *corpus, const char *path) {
+    memset(corpus, 0, sizeof(*corpus));
+    int fd = open(path, O_RDONLY);
+    if (fd < 0) return false;
+    struct stat st;
+    if (fstat(fd, &st) != 0 || st.st_size < CORPUS_HEADER_SIZE) {
+        close(fd);
+        return false;
+    }
+    void *map = mmap(NULL, (size_t)st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (map == MAP_FAILED) return false;
+    corpus->map = map;
+    corpus->size = (size_t)st.st_size;
+
+    const uint8_t *header = corpus->map;
+    uint64_t count = get_le(header + 8, 4);
+    uint64_t index_offset = get_le(header + 16, 8);
+    if (memcmp(header, corpus_magic, sizeof(corpus_magic)) != 0 ||
+        header[4] != CORPUS_VERSION || index_offset < CORPUS_HEADER_SIZE ||
+        index_offset > corpus->size ||
+        count > (corpus->size - index_offset) / CORPUS_ENTRY_SIZE) {
+        corpus_close(corpus);
+        return false;
+    }
+    corpus->count = (uint32_t)count;
+    corpus->index = corpus->map + index_offset;
+
+    // Bounds-check every entry once so iteration never has to
+    for (uint32_t i = 0; i < corpus->count; i++) {
+        CorpusEntry entry;
+        const uint8_t *replay;
+        corpus_entry(corpus, i, &entry, &replay);
+        if (entry.offset < CORPUS_HEADER_SIZE || entry.offset > index_offset ||
+            entry.size > index_offset - entry.offset) {
+            corpus_close(corpus);
+            return false;
+        }
+    }
+    // Workers touch replays in roughly file order
+    madvise((void *)corpus->map, corpus->size, MADV_WILLNEED);
+    return true;
+}
+
+void corpus_close(Corpus *corpus) {
+    if (corpus->map) munmap((void *)corpus->map, corpus->size);
+    memset(corpus, 0, sizeof(*corpus));
+}
+
+// Per-worker totals, padded so workers never share a line
+typedef struct {
+    _Alignas(64) CorpusReport report;
+} VerifyPartial;
+
+typedef struct {
+    const Corpus *corpus;
+    VerifyPartial *partials;
+} VerifyJob;
+
+static void verify_task(uint32_t index, int worker, void *ctx) {
+    VerifyJob *job = ctx;
+    CorpusReport *partial = &job->partials[worker].report;
+    CorpusEntry entry;
+    const uint8_t *replay;
+    corpus_entry(job->corpus, index, &entry, &replay);
+
+    GameState game;
+    ReplayInfo info;
+    ReplayStatus status = replay_run(replay, entry.size, &game, &info);
+    if (status == REPLAY_OK &&
+        (game.score != entry.score || replay_board_hash(&game) != entry.board_hash)) {
+        status = REPLAY_MISMATCH;
+    }
+
+    partial->games++;
+    partial->total_inputs += info.inputs;
+    if (status == REPLAY_OK) {
+        partial->passed++;
+        return;
+    }
+    if (status == REPLAY_CORRUPT) {
+        partial->corrupt++;
+    } else {
+        partial->mismatched++;
+    }
+    if (index < partial->first_failure) partial->first_failure = index;
+}
+
+int corpus_verify(const Corpus *corpus, int threads, CorpusReport *report) {
+    threads = sim_thread_count(threads, corpus->count);
+    VerifyPartial *partials = aligned_alloc(64, sizeof(VerifyPartial) * (size_t)threads);
+    if (!partials) return -1;
+    memset(partials, 0, sizeof(VerifyPartial) * (size_t)threads);
+    for (int i = 0; i < threads; i++) partials[i].report.first_failure = corpus->count;
+
+    VerifyJob job = {.corpus = corpus, .partials = partials};
+    struct timespec start, end;
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    int started = sim_parallel_for(corpus->count, threads, verify_task, &job);
+    clock_gettime(CLOCK_MONOTONIC, &end);
+    if (started < 0) {
+        free(partials);
+        return -1;
+    }
+
+    memset(report, 0, sizeof(*report));
+    report->first_failure = corpus->count;
+    report->threads = started;
+    report->seconds = (double)(end.tv_sec - start.tv_sec) +
+                      (double)(end.tv_nsec - start.tv_nsec) * 1e-9;
+    for (int i = 0; i < threads; i++) {
+        const CorpusReport *p = &partials[i].report;
+        report->games += p->games;
+        report->passed += p->passed;
+        report->corrupt += p->corrupt;
+        report->mismatched += p->mismatched;
+        report->total_inputs += p->total_inputs;
+        if (p->first_failure < report->first_failure) report->first_failure = p->first_failure;
+    }
+    free(partials);
+    return 0;
+}
@@ -0,0 +1,86 @@
+#ifndef TETRIS_CORPUS_H
+#define TETRIS_CORPUS_H
+
+#include <pthread.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+
+#include "tetris_engine.h"
+
+// Multi-game replay container, read through mmap without copying:
+//
+//   header  "TTRC" version:u8 reserved:u8[3] count:u32 reserved:u32
+//           index_offset:u64
+//   replays concatenated tetris_replay.h recordings
+//   index   count x { offset:u64 size:u32 score:u32 board_hash:u64 }
+//
+// All integers are little-endian. The index trails the replays so a corpus
+// can be streamed out as games finish; the header points at it.
+
+#define CORPUS_VERSION 1
+#define CORPUS_HEADER_SIZE 24
+#define CORPUS_ENTRY_SIZE 24
+
+typedef struct {
+    uint64_t offset;
+    uint32_t size;
+    int score;
+    uint64_t board_hash;  // replay_board_hash of the final board
+} CorpusEntry;
+
+typedef struct {
+    FILE *file;
+    pthread_mutex_t lock;
+    uint64_t offset;
+    uint32_t count;
+    CorpusEntry *entries;  // By game index, whatever order games finish in
+    bool failed;
+} CorpusWriter;
+
+// Create a corpus for count games
+bool corpus_writer_open(CorpusWriter *writer, const char *path, uint32_t count)
+    __attribute__((nonnull));
+
+// Append the replay of game index and its final state; thread-safe. An
+// empty replay marks the game as failed.
+void corpus_writer_add(CorpusWriter *writer, uint32_t index, const uint8_t *replay,
+                       size_t size, const GameState *game) __attribute__((nonnull(1, 5)));
+
+// Write the index and close; false if anything failed or a game is missing
+bool corpus_writer_close(CorpusWriter *writer) __attribute__((nonnull));
+
+typedef struct {
+    const uint8_t *map;
+    size_t size;
+    uint32_t count;
+    const uint8_t *index;
+} Corpus;
+
+// Map a corpus read-only and validate its index; false on error
+bool corpus_open(Corpus *corpus, const char *path) __attribute__((nonnull));
+
+void corpus_close(Corpus *corpus) __attribute__((nonnull));
+
+// Entry i and a pointer to its replay inside the mapping
+void corpus_entry(const Corpus *corpus, uint32_t i, CorpusEntry *entry,
+                  const uint8_t **replay) __attribute__((nonnull));
+
+typedef struct {
+    uint32_t games;
+    uint32_t passed;
+    uint32_t corrupt;     // Replays that do not decode
+    uint32_t mismatched;  // Replays that diverge in score or final board
+    uint32_t first_failure;  // Lowest failing game index, count if none
+    uint64_t total_inputs;
+    int threads;
+    double seconds;
+} CorpusReport;
+
+// Re-simulate every game on the simulator's thread pool and check its final
+// score and board hash; returns 0 once all games ran, -1 if no worker started
+int corpus_verify(const Corpus *corpus, int threads, CorpusReport *report)
+    __attribute__((nonnull));
+
+#endif
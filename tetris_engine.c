@@ -0,0 +1,621 @@
+#include "tetris_engine.h"
+
+#include <limits.h>
+#include <string.h>
+
+const Tetromino tetrominoes[TETROMINO_COUNT] = {
+    {{{0,0}, {0,1}, {1,0}, {1,1}}, {1.0, 1.0, 0.0}}, // Square
+    {{{0,0}, {0,1}, {0,2}, {0,3}}, {0.0, 1.0, 1.0}}, // Line
+    {{{0,0}, {0,1}, {1,1}, {1,2}}, {1.0, 0.0, 0.0}}, // Z
+    {{{0,1}, {0,2}, {1,0}, {1,1}}, {0.0, 1.0, 0.0}}, // S
+    {{{0,0}, {0,1}, {0,2}, {1,1}}, {1.0, 0.0, 1.0}}, // T
+    {{{0,0}, {1,0}, {2,0}, {2,1}}, {1.0, 0.5, 0.0}}, // L
+    {{{0,1}, {1,1}, {2,0}, {2,1}}, {0.0, 0.0, 1.0}}  // J
+};
+
+const PieceRotation piece_rotations[TETROMINO_COUNT][4] = {
+    { // Square
+        {{{0,0}, {0,1}, {1,0}, {1,1}}, {0x3, 0x3, 0x0, 0x0}, {1, 1, -1, -1}, 2, 2, 0, 0},
+        {{{0,1}, {1,1}, {0,0}, {1,0}}, {0x3, 0x3, 0x0, 0x0}, {1, 1, -1, -1}, 2, 2, 0, 0},
+        {{{1,1}, {1,0}, {0,1}, {0,0}}, {0x3, 0x3, 0x0, 0x0}, {1, 1, -1, -1}, 2, 2, 0, 0},
+        {{{1,0}, {0,0}, {1,1}, {0,1}}, {0x3, 0x3, 0x0, 0x0}, {1, 1, -1, -1}, 2, 2, 0, 0},
+    },
+    { // Line
+        {{{0,0}, {0,1}, {0,2}, {0,3}}, {0x1, 0x1, 0x1, 0x1}, {3, -1, -1, -1}, 1, 4, 0, 0},
+        {{{0,0}, {1,0}, {2,0}, {3,0}}, {0xf, 0x0, 0x0, 0x0}, {0, 0, 0, 0}, 4, 1, -2, 1},
+        {{{0,3}, {0,2}, {0,1}, {0,0}}, {0x1, 0x1, 0x1, 0x1}, {3, -1, -1, -1}, 1, 4, 0, 0},
+        {{{3,0}, {2,0}, {1,0}, {0,0}}, {0xf, 0x0, 0x0, 0x0}, {0, 0, 0, 0}, 4, 1, -2, 1},
+    },
+    { // Z
+        {{{0,0}, {0,1}, {1,1}, {1,2}}, {0x1, 0x3, 0x2, 0x0}, {1, 2, -1, -1}, 2, 3, 0, 0},
+        {{{0,1}, {1,1}, {1,0}, {2,0}}, {0x6, 0x3, 0x0, 0x0}, {1, 1, 0, -1}, 3, 2, -1, 0},
+        {{{1,2}, {1,1}, {0,1}, {0,0}}, {0x1, 0x3, 0x2, 0x0}, {1, 2, -1, -1}, 2, 3, 0, 0},
+        {{{2,0}, {1,0}, {1,1}, {0,1}}, {0x6, 0x3, 0x0, 0x0}, {1, 1, 0, -1}, 3, 2, -1, 0},
+    },
+    { // S
+        {{{0,1}, {0,2}, {1,0}, {1,1}}, {0x2, 0x3, 0x1, 0x0}, {2, 1, -1, -1}, 2, 3, 0, 0},
+        {{{1,1}, {2,1}, {0,0}, {1,0}}, {0x3, 0x6, 0x0, 0x0}, {0, 1, 1, -1}, 3, 2, -1, 0},
+        {{{1,1}, {1,0}, {0,2}, {0,1}}, {0x2, 0x3, 0x1, 0x0}, {2, 1, -1, -1}, 2, 3, 0, 0},
+        {{{1,0}, {0,0}, {2,1}, {1,1}}, {0x3, 0x6, 0x0, 0x0}, {0, 1, 1, -1}, 3, 2, -1, 0},
+    },
+    { // T
+        {{{0,0}, {0,1}, {0,2}, {1,1}}, {0x1, 0x3, 0x1, 0x0}, {2, 1, -1, -1}, 2, 3, 0, 0},
+        {{{0,1}, {1,1}, {2,1}, {1,0}}, {0x2, 0x7, 0x0, 0x0}, {1, 1, 1, -1}, 3, 2, -1, 0},
+        {{{1,2}, {1,1}, {1,0}, {0,1}}, {0x2, 0x3, 0x2, 0x0}, {1, 2, -1, -1}, 2, 3, 0, 0},
+        {{{2,0}, {1,0}, {0,0}, {1,1}}, {0x7, 0x2, 0x0, 0x0}, {0, 1, 0, -1}, 3, 2, -1, 0},
+    },
+    { // L
+        {{{0,0}, {1,0}, {2,0}, {2,1}}, {0x7, 0x4, 0x0, 0x0}, {0, 0, 1, -1}, 3, 2, 0, 0},
+        {{{0,2}, {0,1}, {0,0}, {1,0}}, {0x3, 0x1, 0x1, 0x0}, {2, 0, -1, -1}, 2, 3, 0, -1},
+        {{{2,1}, {1,1}, {0,1}, {0,0}}, {0x1, 0x7, 0x0, 0x0}, {1, 1, 1, -1}, 3, 2, 0, 0},
+        {{{1,0}, {1,1}, {1,2}, {0,2}}, {0x2, 0x2, 0x3, 0x0}, {2, 2, -1, -1}, 2, 3, 0, -1},
+    },
+    { // J
+        {{{0,1}, {1,1}, {2,0}, {2,1}}, {0x4, 0x7, 0x0, 0x0}, {1, 1, 1, -1}, 3, 2, 0, 0},
+        {{{1,2}, {1,1}, {0,0}, {1,0}}, {0x3, 0x2, 0x2, 0x0}, {0, 2, -1, -1}, 2, 3, 0, -1},
+        {{{2,0}, {1,0}, {0,1}, {0,0}}, {0x7, 0x1, 0x0, 0x0}, {1, 0, 0, -1}, 3, 2, 0, 0},
+        {{{0,0}, {0,1}, {1,2}, {0,2}}, {0x1, 0x1, 0x3, 0x0}, {2, 2, -1, -1}, 2, 3, 0, -1},
+    },
+};
+
+#define PCG_MULTIPLIER 6364136223846793005ULL
+#define PCG_INCREMENT 1442695040888963407ULL
+
+void tetris_rng_seed(TetrisRng *rng, uint64_t seed) {
+    rng->state = 0;
+    tetris_rng_next(rng);
+    rng->state += seed;
+    tetris_rng_next(rng);
+}
+
+uint32_t tetris_rng_next(TetrisRng *rng) {
+    uint64_t old = rng->state;
+    rng->state = old * PCG_MULTIPLIER + PCG_INCREMENT;
+    uint32_t xorshifted = (uint32_t)(((old >> 18) ^ old) >> 27);
+    uint32_t rot = (uint32_t)(old >> 59);
+    return (xorshifted >> rot) | (xorshifted << ((-rot) & 31));
+}
+
+// Secure random number generator
+static int secure_rand(GameState *game, int max) {
+    return tetris_rng_below(&game->rng, max);
+}
+
+static int draw_bag(GameState *game) {
+    if (game->bag_left == 0) {
+        for (int i = 0; i < TETROMINO_COUNT; i++) game->bag[i] = (uint8_t)i;
+        game->bag_left = TETROMINO_COUNT;
+    }
+    // Take a random remaining piece and fill its slot from the end
+    int i = secure_rand(game, game->bag_left);
+    int type = game->bag[i];
+    game->bag[i] = game->bag[--game->bag_left];
+    return type;
+}
+
+static int draw_history(GameState *game) {
+    int type = 0;
+    for (int roll = 0; roll < HISTORY_LENGTH; roll++) {
+        type = secure_rand(game, TETROMINO_COUNT);
+        if (!memchr(game->history, type, HISTORY_LENGTH)) break;
+    }
+    memmove(game->history + 1, game->history, HISTORY_LENGTH - 1);
+    game->history[0] = (uint8_t)type;
+    return type;
+}
+
+static int draw_piece(GameState *game) {
+    switch (game->randomizer) {
+        case TETRIS_RANDOMIZER_BAG:
+            return draw_bag(game);
+        case TETRIS_RANDOMIZER_HISTORY:
+            return draw_history(game);
+        default:
+            return secure_rand(game, TETROMINO_COUNT);
+    }
+}
+
+void tetris_init_randomizer(GameState *game, uint64_t seed, TetrisRandomizer randomizer) {
+    memset(game, 0, sizeof(GameState));
+    game->game_speed = BASE_GAME_SPEED;
+    game->level = 1;
+    tetris_rng_seed(&game->rng, seed);
+    game->randomizer = randomizer < TETRIS_RANDOMIZER_COUNT ? (uint8_t)randomizer : 0;
+    // Start the history full of S and Z so neither opens the game
+    static const uint8_t first_history[HISTORY_LENGTH] = {2, 3, 2, 3};
+    memcpy(game->history, first_history, sizeof(first_history));
+    // Pieces are drawn in play order, so the uniform sequence does not
+    // depend on the preview depth
+    for (int i = 0; i < PREVIEW_DEPTH; i++) game->preview[i] = (uint8_t)draw_piece(game);
+    tetris_new_piece(game);
+}
+
+void tetris_init(GameState *game, uint64_t seed) {
+    tetris_init_randomizer(game, seed, TETRIS_RANDOMIZER_UNIFORM);
+}
+
+void tetris_new_piece(GameState *game) {
+    // The slot just consumed becomes the back of the queue
+    uint8_t *slot = &game->preview[game->preview_head];
+    game->current_type = *slot;
+    *slot = (uint8_t)draw_piece(game);
+    game->preview_head = (game->preview_head + 1) & (PREVIEW_DEPTH - 1);
+    game->pieces++;
+    game->current_x = BOARD_WIDTH / 2 - 2;
+    game->current_y = 0;
+    game->current_rotation = 0;
+}
+
+bool tetris_can_place(const GameState *game, int type, int rotation, int x, int y) {
+    const PieceRotation *piece = &piece_rotations[type][rotation];
+    if (x < 0 || x + piece->width > BOARD_WIDTH || y + piece->height > BOARD_HEIGHT) {
+        return false;
+    }
+    for (int r = 0; r < piece->height; r++) {
+        if (y + r >= 0 && (game->rows[y + r] & (piece->row_mask[r] << x))) {
+            return false;
+        }
+    }
+    return true;
+}
+
+bool tetris_can_move(const GameState *game, int dx, int dy) {
+    return tetris_can_place(game, game->current_type, game->current_rotation,
+                            game->current_x + dx, game->current_y + dy);
+}
+
+bool tetris_move(GameState *game, int dx, int dy) {
+    if (!tetris_can_move(game, dx, dy)) return false;
+    game->current_x += dx;
+    game->current_y += dy;
+    return true;
+}
+
+bool tetris_rotate(GameState *game) {
+    const PieceRotation *from = tetris_current_piece(game);
+    int rotation = (game->current_rotation + 1) & 3;
+    const PieceRotation *to = &piece_rotations[game->current_type][rotation];
+    int x = game->current_x + to->offset_x - from->offset_x;
+    int y = game->current_y + to->offset_y - from->offset_y;
+    if (!tetris_can_place(game, game->current_type, rotation, x, y)) return false;
+    game->current_rotation = rotation;
+    game->current_x = x;
+    game->current_y = y;
+    return true;
+}
+
+uint64_t tetris_zobrist[BOARD_HEIGHT][ZOBRIST_CHUNKS][16];
+
+// Fixed-seed keys, so hashes are stable from run to run
+__attribute__((constructor)) static void init_zobrist(void) {
+    TetrisRng rng;
+    tetris_rng_seed(&rng, 0x5a0b7157ULL);
+    for (int y = 0; y < BOARD_HEIGHT; y++) {
+        for (int c = 0; c < ZOBRIST_CHUNKS; c++) {
+            uint64_t cell[4];
+            for (int b = 0; b < 4; b++) {
+                uint64_t hi = tetris_rng_next(&rng);
+                cell[b] = hi << 32 | tetris_rng_next(&rng);
+            }
+            // Columns past the board edge never get set
+            for (int m = 0; m < 16; m++) {
+                uint64_t key = 0;
+                for (int b = 0; b < 4; b++) {
+                    if (m & (1 << b)) key ^= cell[b];
+                }
+                tetris_zobrist[y][c][m] = key;
+            }
+        }
+    }
+}
+
+// XOR the keys of rows [from, to] in or out of board_hash
+static void hash_rows(GameState *game, int from, int to) {
+    if (from < 0) from = 0;
+    if (to >= BOARD_HEIGHT) to = BOARD_HEIGHT - 1;
+    for (int y = from; y <= to; y++) {
+        if (game->rows[y]) game->board_hash ^= tetris_row_key(y, game->rows[y]);
+    }
+}
+
+void tetris_land_piece(GameState *game) {
+    const PieceRotation *piece = tetris_current_piece(game);
+    int first_row = game->current_y, last_row = game->current_y + piece->height - 1;
+    hash_rows(game, first_row, last_row);
+    for (int i = 0; i < 4; i++) {
+        int x = game->current_x + piece->cells[i][0];
+        int y = game->current_y + piece->cells[i][1];
+        if (y >= 0 && x >= 0 && x < BOARD_WIDTH && y < BOARD_HEIGHT) {
+            game->rows[y] |= (uint16_t)(1u << x);
+            int shift = x * COLOR_BITS;
+            game->colors[y] = (game->colors[y] & ~((TetrisColorRow)COLOR_MASK << shift)) |
+                              ((TetrisColorRow)(game->current_type + 1) << shift);
+            game->row_fill[y]++;
+            game->pending_rows |= 1u << y;
+
+            // Above the old top every skipped cell becomes a hole; below it the
+            // block fills one. Either way the result is order independent.
+            int top = BOARD_HEIGHT - game->col_height[x];
+            if (y < top) {
+                game->col_holes[x] += (uint8_t)(top - y - 1);
+                game->col_height[x] = (uint8_t)(BOARD_HEIGHT - y);
+            } else {
+                game->col_holes[x]--;
+            }
+        }
+    }
+    hash_rows(game, first_row, last_row);
+}
+
+void tetris_rebuild_features(GameState *game) {
+    memset(game->col_height, 0, sizeof(game->col_height));
+    memset(game->col_holes, 0, sizeof(game->col_holes));
+    uint16_t seen = 0;
+    for (int y = 0; y < BOARD_HEIGHT; y++) {
+        uint16_t row = game->rows[y];
+        game->row_fill[y] = (uint8_t)__builtin_popcount(row);
+        for (uint32_t fresh = row & (uint16_t)~seen; fresh; fresh &= fresh - 1) {
+            game->col_height[__builtin_ctz(fresh)] = (uint8_t)(BOARD_HEIGHT - y);
+        }
+        for (uint32_t gaps = seen & (uint16_t)~row; gaps; gaps &= gaps - 1) {
+            game->col_holes[__builtin_ctz(gaps)]++;
+        }
+        seen |= row;
+    }
+    game->pending_rows = (uint32_t)((1ull << BOARD_HEIGHT) - 1);
+    game->board_hash = 0;
+    hash_rows(game, 0, BOARD_HEIGHT - 1);
+}
+
+int tetris_clear_lines(GameState *game) {
+    // Only rows touched since the last clear can have become full
+    uint32_t cleared = 0;
+    for (uint32_t rows = game->pending_rows; rows; rows &= rows - 1) {
+        int y = __builtin_ctz(rows);
+        if (game->row_fill[y] == BOARD_WIDTH) cleared |= 1u << y;
+    }
+    game->pending_rows = 0;
+    game->cleared_rows = cleared;
+    if (!cleared) return 0;
+
+    // Compact surviving rows towards the bottom, starting at the lowest
+    // cleared row, then blank the rows freed at the top. Rows above the
+    // stack are empty and stay so, so only [stack_top, lowest] is touched.
+    int lines = __builtin_popcount(cleared);
+    int lowest = 31 - __builtin_clz(cleared);
+    int tallest = 0;
+    for (int x = 0; x < BOARD_WIDTH; x++) {
+        if (game->col_height[x] > tallest) tallest = game->col_height[x];
+    }
+    int stack_top = BOARD_HEIGHT - tallest;
+    hash_rows(game, stack_top, lowest);
+    int dst = lowest;
+    for (int y = lowest; y >= stack_top; y--) {
+        if (cleared & (1u << y)) continue;
+        game->rows[dst] = game->rows[y];
+        game->colors[dst] = game->colors[y];
+        game->row_fill[dst] = game->row_fill[y];
+        dst--;
+    }
+    for (; dst >= stack_top; dst--) {
+        game->rows[dst] = 0;
+        game->colors[dst] = 0;
+        game->row_fill[dst] = 0;
+    }
+    hash_rows(game, stack_top + lines, lowest);
+
+    // Every cleared row lay inside every column, so heights drop by `lines`.
+    // If the old top went with a cleared row, the column may now start with
+    // cells that used to be holes.
+    for (int x = 0; x < BOARD_WIDTH; x++) {
+        int height = game->col_height[x] - lines;
+        while (height > 0 && !(game->rows[BOARD_HEIGHT - height] & (1u << x))) {
+            height--;
+            game->col_holes[x]--;
+        }
+        game->col_height[x] = (uint8_t)height;
+    }
+
+    game->lines += lines;
+
+    // Prevent integer overflow
+    game->score = (game->score > INT_MAX - lines * 100 * game->level) ?
+                  INT_MAX : game->score + lines * 100 * game->level;
+
+    if (game->score >= game->level * LEVEL_THRESHOLD && game->level < MAX_LEVEL) {
+        game->level++;
+        game->game_speed = BASE_GAME_SPEED / game->level;
+    }
+    return lines;
+}
+
+void tetris_queue_garbage(GameState *game, int lines, int hole) {
+    if (lines <= 0) return;
+    if (lines > BOARD_HEIGHT) lines = BOARD_HEIGHT;
+    if (hole < 0 || hole >= BOARD_WIDTH) hole = 0;
+    if (game->garbage_count == GARBAGE_QUEUE_DEPTH) {
+        TetrisGarbage *last = &game->garbage[GARBAGE_QUEUE_DEPTH - 1];
+        int merged = last->lines + lines;
+        last->lines = (uint8_t)(merged > BOARD_HEIGHT ? BOARD_HEIGHT : merged);
+        return;
+    }
+    game->garbage[game->garbage_count++] = (TetrisGarbage){(uint8_t)lines, (uint8_t)hole};
+}
+
+int tetris_garbage_pending(const GameState *game) {
+    int total = 0;
+    for (int i = 0; i < game->garbage_count; i++) total += game->garbage[i].lines;
+    return total;
+}
+
+// Cancel an outgoing attack against the oldest queued garbage; returns what
+// is left to send
+static int cancel_garbage(GameState *game, int attack) {
+    int done = 0;
+    while (attack > 0 && done < game->garbage_count) {
+        TetrisGarbage *front = &game->garbage[done];
+        int take = attack < front->lines ? attack : front->lines;
+        front->lines = (uint8_t)(front->lines - take);
+        attack -= take;
+        if (front->lines == 0) done++;
+    }
+    if (done) {
+        game->garbage_count = (uint8_t)(game->garbage_count - done);
+        memmove(game->garbage, game->garbage + done, sizeof(TetrisGarbage) * game->garbage_count);
+    }
+    return attack;
+}
+
+// Raise the whole queue at once: each row array moves up in a single
+// memmove and the garbage fills the bottom, newest attack lowest. Row keys
+// depend on y, so the hash is rebuilt. Returns true if cells were pushed
+// off the top.
+static bool rise_garbage(GameState *game) {
+    int total = tetris_garbage_pending(game);
+    if (total > BOARD_HEIGHT) total = BOARD_HEIGHT;
+    int kept = BOARD_HEIGHT - total;
+    bool topped_out = false;
+    for (int y = 0; y < total; y++) topped_out |= game->rows[y] != 0;
+
+    memmove(game->rows, game->rows + total, sizeof(game->rows[0]) * (size_t)kept);
+    memmove(game->colors, game->colors + total, sizeof(game->colors[0]) * (size_t)kept);
+    memmove(game->row_fill, game->row_fill + total, (size_t)kept);
+    game->pending_rows >>= total;
+
+    int y = BOARD_HEIGHT - 1;
+    for (int i = game->garbage_count - 1; i >= 0 && y >= kept; i--) {
+        uint16_t row = FULL_ROW & (uint16_t)~(1u << game->garbage[i].hole);
+        for (int k = 0; k < game->garbage[i].lines && y >= kept; k++, y--) {
+            game->rows[y] = row;
+            game->colors[y] = 0;  // Garbage cells are occupied but colorless
+            game->row_fill[y] = BOARD_WIDTH - 1;
+        }
+    }
+    game->garbage_count = 0;
+
+    if (topped_out) {
+        tetris_rebuild_features(game);
+        return true;
+    }
+    // Standing columns grow by total; the garbage rows then count holes and
+    // new column tops the way tetris_rebuild_features does
+    uint16_t seen = 0;
+    for (int x = 0; x < BOARD_WIDTH; x++) {
+        if (!game->col_height[x]) continue;
+        game->col_height[x] = (uint8_t)(game->col_height[x] + total);
+        seen |= (uint16_t)(1u << x);
+    }
+    for (y = kept; y < BOARD_HEIGHT; y++) {
+        uint16_t row = game->rows[y];
+        for (uint32_t fresh = row & (uint16_t)~seen; fresh; fresh &= fresh - 1) {
+            game->col_height[__builtin_ctz(fresh)] = (uint8_t)(BOARD_HEIGHT - y);
+        }
+        for (uint32_t gaps = seen & (uint16_t)~row; gaps; gaps &= gaps - 1) {
+            game->col_holes[__builtin_ctz(gaps)]++;
+        }
+        seen |= row;
+    }
+    game->board_hash = 0;
+    hash_rows(game, 0, BOARD_HEIGHT - 1);
+    return false;
+}
+
+unsigned tetris_lock_piece(GameState *game) {
+    // Garbage rows sent per clear of 0-4 lines
+    static const uint8_t attack_for_lines[5] = {0, 0, 1, 2, 4};
+    unsigned events = TETRIS_EVENT_LANDED;
+    int level = game->level;
+    bool topped_out = false;
+    tetris_land_piece(game);
+    int lines = tetris_clear_lines(game);
+    if (lines > 0) events |= TETRIS_EVENT_LINES;
+    if (game->level != level) events |= TETRIS_EVENT_LEVEL_UP;
+    game->attack_lines = 0;
+    if (lines) {
+        game->attack_lines = (uint8_t)cancel_garbage(game, attack_for_lines[lines]);
+    } else if (game->garbage_count) {
+        topped_out = rise_garbage(game);
+        events |= TETRIS_EVENT_GARBAGE;
+    }
+    tetris_new_piece(game);
+    if (topped_out || !tetris_can_move(game, 0, 0)) {
+        game->game_over = true;
+        events |= TETRIS_EVENT_GAME_OVER;
+    }
+    return events;
+}
+
+int tetris_landing_row(const GameState *game, int type, int rotation, int x, int y) {
+    const PieceRotation *piece = &piece_rotations[type][rotation];
+    int land = BOARD_HEIGHT - piece->height;
+    bool above_stack = true;
+    for (int c = 0; c < piece->width; c++) {
+        int top = BOARD_HEIGHT - game->col_height[x + c];
+        int bottom = piece->col_bottom[c];
+        if (y + bottom >= top) above_stack = false;
+        if (top - 1 - bottom < land) land = top - 1 - bottom;
+    }
+    if (above_stack) return land;
+
+    // Tucked under an overhang: the column tops say nothing, step down
+    while (tetris_can_place(game, type, rotation, x, y + 1)) y++;
+    return y;
+}
+
+unsigned tetris_hard_drop(GameState *game) {
+    if (game->paused || game->game_over) return 0;
+
+    game->current_y = tetris_landing_row(game, game->current_type, game->current_rotation,
+                                         game->current_x, game->current_y);
+    return tetris_lock_piece(game);
+}
+
+unsigned tetris_apply_input(GameState *game, TetrisInput input) {
+    if (game->paused || game->game_over) return 0;
+
+    switch (input) {
+        case TETRIS_INPUT_LEFT:
+            return tetris_move(game, -1, 0) ? TETRIS_EVENT_MOVED : 0;
+        case TETRIS_INPUT_RIGHT:
+            return tetris_move(game, 1, 0) ? TETRIS_EVENT_MOVED : 0;
+        case TETRIS_INPUT_SOFT_DROP:
+            return tetris_move(game, 0, 1) ? TETRIS_EVENT_MOVED : 0;
+        case TETRIS_INPUT_ROTATE:
+            return tetris_rotate(game) ? TETRIS_EVENT_MOVED : 0;
+        case TETRIS_INPUT_HARD_DROP:
+            return tetris_hard_drop(game);
+        default:
+            return 0;
+    }
+}
+
+unsigned tetris_tick(GameState *game) {
+    if (game->paused || game->game_over) return 0;
+
+    game->ticks++;
+    if (tetris_move(game, 0, 1)) return TETRIS_EVENT_MOVED;
+    return tetris_lock_piece(game);
+}
+
+static uint8_t *put_le(uint8_t *p, uint64_t value, int bytes) {
+    for (int i = 0; i < bytes; i++) *p++ = (uint8_t)(value >> (8 * i));
+    return p;
+}
+
+static uint64_t get_le(const uint8_t **p, int bytes) {
+    uint64_t value = 0;
+    for (int i = 0; i < bytes; i++) value |= (uint64_t)*(*p)++ << (8 * i);
+    return value;
+}
+
+// Pack count values below 16 two to a byte, low nibble first
+static uint8_t *put_nibbles(uint8_t *p, const uint8_t *values, int count) {
+    for (int i = 0; i < count; i += 2) {
+        *p++ = (uint8_t)(values[i] | (i + 1 < count ? values[i + 1] << 4 : 0));
+    }
+    return p;
+}
+
+// Unpack count nibbles; false if any is not below limit
+static bool get_nibbles(const uint8_t **p, uint8_t *values, int count, int limit) {
+    bool valid = true;
+    for (int i = 0; i < count; i++) {
+        values[i] = (uint8_t)((**p >> (4 * (i & 1))) & 15);
+        valid &= values[i] < limit;
+        if (i & 1 || i + 1 == count) (*p)++;
+    }
+    return valid;
+}
+
+void tetris_snapshot_save(const GameState *game, TetrisSnapshot *out) {
+    uint8_t *p = out->bytes;
+    *p++ = TETRIS_SNAPSHOT_VERSION;
+    *p++ = BOARD_WIDTH;
+    *p++ = BOARD_HEIGHT;
+    for (int y = 0; y < BOARD_HEIGHT; y++) {
+        uint64_t row = game->rows[y] | (uint64_t)game->colors[y] << BOARD_WIDTH;
+        p = put_le(p, row, TETRIS_SNAPSHOT_ROW_BYTES);
+    }
+    *p++ = (uint8_t)(game->current_type | game->current_rotation << 3 |
+                     game->game_over << 5 | game->paused << 6);
+    *p++ = (uint8_t)game->current_x;
+    *p++ = (uint8_t)game->current_y;
+    uint8_t preview[PREVIEW_DEPTH];
+    for (int i = 0; i < PREVIEW_DEPTH; i++) preview[i] = (uint8_t)tetris_preview(game, i);
+    p = put_nibbles(p, preview, PREVIEW_DEPTH);
+    p = put_le(p, (uint32_t)game->score, 4);
+    p = put_le(p, (uint32_t)game->lines, 4);
+    p = put_le(p, (uint32_t)game->pieces, 4);
+    p = put_le(p, game->ticks, 4);
+    *p++ = (uint8_t)game->level;
+    p = put_le(p, game->rng.state, 8);
+    *p++ = (uint8_t)(game->randomizer | game->bag_left << 2);
+    p = put_nibbles(p, game->bag, TETROMINO_COUNT);
+    p = put_nibbles(p, game->history, HISTORY_LENGTH);
+    *p++ = game->garbage_count;
+    *p++ = game->attack_lines;
+    for (int i = 0; i < GARBAGE_QUEUE_DEPTH; i++) {
+        *p++ = game->garbage[i].lines;
+        *p++ = game->garbage[i].hole;
+    }
+}
+
+bool tetris_snapshot_restore(GameState *game, const TetrisSnapshot *snapshot) {
+    const uint8_t *p = snapshot->bytes;
+    if (p[0] != TETRIS_SNAPSHOT_VERSION || p[1] != BOARD_WIDTH || p[2] != BOARD_HEIGHT) {
+        return false;
+    }
+    p += 3;
+
+    GameState s;
+    memset(&s, 0, sizeof(s));
+    bool valid = true;
+    for (int y = 0; y < BOARD_HEIGHT; y++) {
+        uint64_t row = get_le(&p, TETRIS_SNAPSHOT_ROW_BYTES);
+        s.rows[y] = (uint16_t)(row & FULL_ROW);
+        s.colors[y] = (TetrisColorRow)(row >> BOARD_WIDTH);
+    }
+    uint8_t piece = *p++;
+    s.current_type = piece & 7;
+    s.current_rotation = (piece >> 3) & 3;
+    s.game_over = piece & 1 << 5;
+    s.paused = piece & 1 << 6;
+    s.current_x = (int8_t)*p++;
+    s.current_y = (int8_t)*p++;
+    valid &= s.current_type < TETROMINO_COUNT;
+    valid &= get_nibbles(&p, s.preview, PREVIEW_DEPTH, TETROMINO_COUNT);
+    s.score = (int)(uint32_t)get_le(&p, 4);
+    s.lines = (int)(uint32_t)get_le(&p, 4);
+    s.pieces = (int)(uint32_t)get_le(&p, 4);
+    s.ticks = (uint32_t)get_le(&p, 4);
+    s.level = *p++;
+    valid &= s.score >= 0 && s.lines >= 0 && s.pieces >= 0;
+    valid &= s.level >= 1 && s.level <= MAX_LEVEL;
+    s.game_speed = BASE_GAME_SPEED / (s.level ? s.level : 1);
+    s.rng.state = get_le(&p, 8);
+    s.randomizer = *p & 3;
+    s.bag_left = *p++ >> 2;
+    valid &= s.randomizer < TETRIS_RANDOMIZER_COUNT && s.bag_left <= TETROMINO_COUNT;
+    valid &= get_nibbles(&p, s.bag, TETROMINO_COUNT, TETROMINO_COUNT);
+    valid &= get_nibbles(&p, s.history, HISTORY_LENGTH, TETROMINO_COUNT);
+    s.garbage_count = *p++;
+    s.attack_lines = *p++;
+    valid &= s.garbage_count <= GARBAGE_QUEUE_DEPTH;
+    for (int i = 0; i < GARBAGE_QUEUE_DEPTH; i++) {
+        s.garbage[i].lines = *p++;
+        s.garbage[i].hole = *p++;
+        valid &= s.garbage[i].lines <= BOARD_HEIGHT && s.garbage[i].hole < BOARD_WIDTH;
+    }
+    if (!valid) return false;
+    // Even a game that is over keeps its piece inside the board box
+    const PieceRotation *box = tetris_current_piece(&s);
+    if (s.current_x < 0 || s.current_x > BOARD_WIDTH - box->width ||
+        s.current_y <= -box->height || s.current_y > BOARD_HEIGHT - box->height) {
+        return false;
+    }
+    if (!s.game_over && !tetris_can_move(&s, 0, 0)) return false;
+
+    tetris_rebuild_features(&s);
+    *game = s;
+    return true;
+}
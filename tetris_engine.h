@@ -0,0 +1,272 @@
+#ifndef TETRIS_ENGINE_H
+#define TETRIS_ENGINE_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+// Headless game rules. Every function operates on a caller-owned GameState,
+// so any number of games can run side by side without a display.
+
+// Game constants. The board size is fixed per build so every mask and loop
+// bound is a constant; build with -DBOARD_WIDTH=16 -DBOARD_HEIGHT=24 for the
+// wide variant.
+#ifndef BOARD_WIDTH
+#define BOARD_WIDTH 10
+#endif
+#ifndef BOARD_HEIGHT
+#define BOARD_HEIGHT 20
+#endif
+#define LEVEL_THRESHOLD 5000
+#define MAX_LEVEL 10  // Added maximum level to prevent integer overflow
+#define TETROMINO_COUNT 7
+#define BASE_GAME_SPEED 500  // Gravity interval at level 1, in ms
+
+// Bitboard layout: one mask per row, bit x set when column x is occupied
+#define FULL_ROW ((uint16_t)((1u << BOARD_WIDTH) - 1))
+#define COLOR_BITS 3
+#define COLOR_MASK 0x7u  // 1 + type; 0 is empty, or garbage where the row bit is set
+
+// One row of packed colors; boards wider than 10 need the 64-bit word
+#if BOARD_WIDTH * COLOR_BITS <= 32
+typedef uint32_t TetrisColorRow;
+#else
+typedef uint64_t TetrisColorRow;
+#endif
+
+_Static_assert(BOARD_WIDTH >= 4 && BOARD_WIDTH <= 16, "row mask must fit in uint16_t");
+_Static_assert(BOARD_HEIGHT >= 4 && BOARD_HEIGHT <= 32, "cleared row mask must fit in uint32_t");
+
+// Secure structure for tetromino data
+typedef struct {
+    int shape[4][2];
+    double color[3];
+} Tetromino;
+
+extern const Tetromino tetrominoes[TETROMINO_COUNT];
+
+// Precomputed rotation states, normalized so the bounding box starts at (0,0).
+// Rotation r+1 is rotation r turned by (x,y)->(y,-x). offset_x/offset_y place
+// the box relative to rotation 0 so the piece stays centered and never drifts.
+typedef struct {
+    int8_t cells[4][2];
+    uint16_t row_mask[4];  // Bit x set for every cell in box row y
+    int8_t col_bottom[4];  // Lowest cell row in each box column, -1 if unused
+    int8_t width, height;
+    int8_t offset_x, offset_y;
+} PieceRotation;
+
+extern const PieceRotation piece_rotations[TETROMINO_COUNT][4];
+
+// Per-game PCG32 generator, so games are reproducible and thread-independent
+typedef struct {
+    uint64_t state;
+} TetrisRng;
+
+void tetris_rng_seed(TetrisRng *rng, uint64_t seed) __attribute__((nonnull));
+uint32_t tetris_rng_next(TetrisRng *rng) __attribute__((nonnull));
+
+// Uniform integer in [0, max)
+static inline int tetris_rng_below(TetrisRng *rng, int max) {
+    return (int)(((uint64_t)tetris_rng_next(rng) * (uint32_t)max) >> 32);
+}
+
+// Piece generators. Uniform draws each piece independently, 7-bag deals
+// shuffled sets of all seven, history rerolls up to four times to avoid any
+// of the last four pieces.
+typedef enum {
+    TETRIS_RANDOMIZER_UNIFORM,
+    TETRIS_RANDOMIZER_BAG,
+    TETRIS_RANDOMIZER_HISTORY,
+    TETRIS_RANDOMIZER_COUNT
+} TetrisRandomizer;
+
+// Upcoming pieces are drawn this far ahead into a ring buffer
+#define PREVIEW_DEPTH 8
+#define HISTORY_LENGTH 4
+_Static_assert((PREVIEW_DEPTH & (PREVIEW_DEPTH - 1)) == 0, "preview ring must be a power of two");
+
+// Versus: an attack waiting in a player's garbage queue, that many rows
+// with a hole in the same column
+#define GARBAGE_QUEUE_DEPTH 8
+typedef struct {
+    uint8_t lines;
+    uint8_t hole;
+} TetrisGarbage;
+
+// Game state structure
+typedef struct {
+    uint16_t rows[BOARD_HEIGHT];    // Occupancy bitboard
+    TetrisColorRow colors[BOARD_HEIGHT];  // Packed 3-bit color per cell (type + 1), draw only
+    int current_x, current_y;
+    int current_rotation;  // Index into piece_rotations[current_type]
+    int current_type;
+    uint8_t preview[PREVIEW_DEPTH];  // Ring of upcoming types, read with tetris_preview()
+    uint8_t preview_head;            // Slot of the next piece
+    int score;
+    int level;
+    int lines;   // Total lines cleared
+    int pieces;  // Total pieces spawned
+    uint32_t ticks;  // Gravity steps taken, the timeline replays are keyed on
+    uint32_t cleared_rows;  // Bit y set for rows removed by the last line clear
+
+    // Incremental board features, kept in sync by land_piece/clear_lines
+    uint8_t row_fill[BOARD_HEIGHT];   // Occupied cells per row
+    uint8_t col_height[BOARD_WIDTH];  // Rows from the floor to the column top, 0 if empty
+    uint8_t col_holes[BOARD_WIDTH];   // Empty cells below the column top
+    uint32_t pending_rows;            // Rows touched since the last line clear
+    uint64_t board_hash;              // XOR of tetris_row_key over the settled rows
+    int game_speed;  // Gravity interval in ms
+    bool game_over;
+    bool paused;
+    TetrisRng rng;
+
+    // Randomizer state
+    uint8_t randomizer;  // TetrisRandomizer
+    uint8_t bag_left;    // Pieces still in bag[0, bag_left)
+    uint8_t bag[TETROMINO_COUNT];
+    uint8_t history[HISTORY_LENGTH];
+
+    // Versus state, idle in single player
+    TetrisGarbage garbage[GARBAGE_QUEUE_DEPTH];  // Incoming attacks, oldest first
+    uint8_t garbage_count;
+    uint8_t attack_lines;  // Sent by the last lock, after cancelling incoming garbage
+} GameState;
+
+// Event bits returned by tetris_tick()
+enum {
+    TETRIS_EVENT_MOVED     = 1 << 0,  // Piece fell one row
+    TETRIS_EVENT_LANDED    = 1 << 1,  // Piece locked and a new one spawned
+    TETRIS_EVENT_LINES     = 1 << 2,  // At least one line was cleared
+    TETRIS_EVENT_LEVEL_UP  = 1 << 3,  // game_speed changed
+    TETRIS_EVENT_GAME_OVER = 1 << 4,
+    TETRIS_EVENT_GARBAGE   = 1 << 5,  // Queued garbage rose into the board
+};
+
+// Player inputs, decoupled from any particular frontend so they can be
+// recorded and replayed
+typedef enum {
+    TETRIS_INPUT_LEFT,
+    TETRIS_INPUT_RIGHT,
+    TETRIS_INPUT_SOFT_DROP,
+    TETRIS_INPUT_ROTATE,
+    TETRIS_INPUT_HARD_DROP,
+    TETRIS_INPUT_COUNT
+} TetrisInput;
+
+// Reset the state, seed its generator, fill the preview and spawn the first
+// piece with the given randomizer; tetris_init uses the uniform one
+void tetris_init_randomizer(GameState *game, uint64_t seed, TetrisRandomizer randomizer)
+    __attribute__((nonnull));
+void tetris_init(GameState *game, uint64_t seed) __attribute__((nonnull));
+
+// Promote the next preview piece to the falling piece and draw one more
+void tetris_new_piece(GameState *game) __attribute__((nonnull));
+
+// Collision test for an arbitrary piece position against the board
+bool tetris_can_place(const GameState *game, int type, int rotation,
+                      int x, int y) __attribute__((nonnull));
+
+bool tetris_can_move(const GameState *game, int dx, int dy) __attribute__((nonnull));
+
+// Move or rotate the falling piece if the target position is free
+bool tetris_move(GameState *game, int dx, int dy) __attribute__((nonnull));
+bool tetris_rotate(GameState *game) __attribute__((nonnull));
+
+void tetris_land_piece(GameState *game) __attribute__((nonnull));
+
+// Recompute the incremental features from the bitboard, for callers that
+// write rows directly; marks every row for the next full-row check
+void tetris_rebuild_features(GameState *game) __attribute__((nonnull));
+
+// Remove full rows and update score and level; returns the number of lines.
+// Only rows in pending_rows are checked. Rows above the lowest bit in
+// cleared_rows have shifted down.
+int tetris_clear_lines(GameState *game) __attribute__((nonnull));
+
+// Row a piece placed at (x, y) comes to rest on. While the piece is above
+// every column top this is O(width) from col_height, otherwise it steps down.
+int tetris_landing_row(const GameState *game, int type, int rotation,
+                       int x, int y) __attribute__((nonnull));
+
+// Drop the falling piece to its landing row and lock it; returns
+// TETRIS_EVENT_* bits
+unsigned tetris_hard_drop(GameState *game) __attribute__((nonnull));
+
+// Land the falling piece, clear lines and spawn the next piece; returns
+// TETRIS_EVENT_* bits
+unsigned tetris_lock_piece(GameState *game) __attribute__((nonnull));
+
+// Queue an attack of lines garbage rows, open in column hole. Each lock that
+// clears lines cancels queued rows before anything is sent on; the first
+// lock that clears none raises everything queued in one shift of the board.
+// A full queue folds the attack into its last entry.
+void tetris_queue_garbage(GameState *game, int lines, int hole) __attribute__((nonnull));
+
+// Rows waiting in the garbage queue
+int tetris_garbage_pending(const GameState *game) __attribute__((nonnull));
+
+// Apply one player input; returns TETRIS_EVENT_* bits, 0 if it had no effect
+unsigned tetris_apply_input(GameState *game, TetrisInput input) __attribute__((nonnull));
+
+// Advance gravity by one step, locking the piece if it cannot fall; returns
+// TETRIS_EVENT_* bits
+unsigned tetris_tick(GameState *game) __attribute__((nonnull, warn_unused_result));
+
+// Snapshots: the whole game as a fixed-size blob, for saving and resuming
+// it or moving it to another process or machine. Integers are little-endian
+// at fixed offsets:
+//
+//   version:u8 width:u8 height:u8
+//   rows[height]   occupancy in bits [0, width), colors in [width, 4 * width)
+//   type:3 rotation:2 game_over:1 paused:1 (one byte), x:i8 y:i8
+//   preview[8]     4 bits each, next piece first
+//   score:u32 lines:u32 pieces:u32 ticks:u32 level:u8 rng:u64
+//   randomizer:2 bag_left:3 (one byte), bag[7] and history[4] 4 bits each
+//   garbage_count:u8 attack_lines:u8 garbage[8] lines:u8 hole:u8
+//
+// game_speed follows from level, and the incremental features and board
+// hash are rebuilt on restore. 160 bytes for the 10x20 board.
+#define TETRIS_SNAPSHOT_VERSION 1
+#define TETRIS_SNAPSHOT_ROW_BYTES ((4 * BOARD_WIDTH + 7) / 8)
+#define TETRIS_SNAPSHOT_SIZE (3 + BOARD_HEIGHT * TETRIS_SNAPSHOT_ROW_BYTES + 57)
+
+typedef struct {
+    uint8_t bytes[TETRIS_SNAPSHOT_SIZE];
+} TetrisSnapshot;
+
+void tetris_snapshot_save(const GameState *game, TetrisSnapshot *out) __attribute__((nonnull));
+
+// Replace game with the snapshot; false, leaving game alone, if it is from
+// another board size or version or describes an impossible state
+bool tetris_snapshot_restore(GameState *game, const TetrisSnapshot *snapshot)
+    __attribute__((nonnull));
+
+static inline const PieceRotation *tetris_current_piece(const GameState *game) {
+    return &piece_rotations[game->current_type][game->current_rotation];
+}
+
+// Zobrist keys, one random 64-bit key per cell, pre-combined for every
+// occupancy of each 4-column chunk of each row. Filled in at load time.
+#define ZOBRIST_CHUNKS ((BOARD_WIDTH + 3) / 4)
+extern uint64_t tetris_zobrist[BOARD_HEIGHT][ZOBRIST_CHUNKS][16];
+
+// XOR of the keys of a row's occupied cells, 0 for an empty row. board_hash
+// is updated by XORing out the old key of each changed row and XORing in the
+// new one.
+static inline uint64_t tetris_row_key(int y, uint16_t row) {
+    uint64_t key = 0;
+    for (int c = 0; c < ZOBRIST_CHUNKS; c++) key ^= tetris_zobrist[y][c][(row >> (4 * c)) & 15];
+    return key;
+}
+
+// Type of the i-th upcoming piece, 0 being the next one; i < PREVIEW_DEPTH
+static inline int tetris_preview(const GameState *game, int i) {
+    return game->preview[(game->preview_head + i) & (PREVIEW_DEPTH - 1)];
+}
+
+// Packed color lookup, 0 for empty cells
+static inline int tetris_cell_color(const GameState *game, int x, int y) {
+    return (int)((game->colors[y] >> (x * COLOR_BITS)) & COLOR_MASK);
+}
+
+#endif
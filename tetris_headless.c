@@ -0,0 +1,18 @@
+#include <stdio.h>
+
+#include "tetris_cli.h"
+
+// gtktetris's headless modes without GTK: the same options and output, but
+// the binary never links the toolkit, so batch jobs that start it thousands
+// of times skip loading and initializing it. Options that need the window
+// are an error.
+
+int main(int argc, char *argv[]) {
+    CliOptions opts = {.preview = 1, .headless = true};
+    cli_select_board(argc, argv);
+    if (!cli_parse_options(&argc, argv, &opts) || argc > 1) {
+        cli_usage(argv[0]);
+        return 2;
+    }
+    return cli_run_headless(&opts);
+}
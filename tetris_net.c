@@ -0,0 +1,428 @@
+#include "tetris_net.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <netdb.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/epoll.h>
+#include <sys/socket.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "tetris_ai.h"
+#include "tetris_sim.h"
+
+#define DEFAULT_MAX_CLIENTS 1024
+#define CLIENT_BACKLOG_MAX (64 * 1024)  // Queued bytes before a slow client is dropped
+#define RESTART_DELAY_MS 3000           // Pause on the final board before the next game
+#define EPOLL_BATCH 64
+
+// Little-endian frame builder over a caller buffer
+typedef struct {
+    uint8_t *data;
+    size_t len, cap;
+} Frame;
+
+static void put(Frame *f, uint64_t value, int bytes) {
+    for (int i = 0; i < bytes && f->len < f->cap; i++) f->data[f->len++] = (uint8_t)(value >> (8 * i));
+}
+
+static size_t begin_frame(Frame *f, int type) {
+    size_t start = f->len;
+    put(f, 0, 2);
+    put(f, (uint64_t)type, 1);
+    return start;
+}
+
+static void end_frame(Frame *f, size_t start) {
+    size_t len = f->len - start - 2;
+    f->data[start] = (uint8_t)len;
+    f->data[start + 1] = (uint8_t)(len >> 8);
+}
+
+typedef struct {
+    const uint8_t *data;
+    size_t len, pos;
+    bool bad;
+} Cursor;
+
+static uint64_t get(Cursor *c, int bytes) {
+    if (c->pos + (size_t)bytes > c->len) {
+        c->bad = true;
+        return 0;
+    }
+    uint64_t value = 0;
+    for (int i = 0; i < bytes; i++) value |= (uint64_t)c->data[c->pos++] << (8 * i);
+    return value;
+}
+
+static void encode_snapshot(Frame *f, const GameState *game) {
+    size_t start = begin_frame(f, NET_MSG_SNAPSHOT);
+    put(f, NET_VERSION, 1);
+    TetrisSnapshot snapshot;
+    tetris_snapshot_save(game, &snapshot);
+    for (int i = 0; i < TETRIS_SNAPSHOT_SIZE; i++) put(f, snapshot.bytes[i], 1);
+    end_frame(f, start);
+}
+
+static bool decode_snapshot(Cursor *c, GameState *game) {
+    if (get(c, 1) != NET_VERSION || c->len - c->pos != TETRIS_SNAPSHOT_SIZE) return false;
+    TetrisSnapshot snapshot;
+    memcpy(snapshot.bytes, c->data + c->pos, TETRIS_SNAPSHOT_SIZE);
+    return tetris_snapshot_restore(game, &snapshot);
+}
+
+static void encode_position(Frame *f, const GameState *game) {
+    put(f, (uint64_t)game->current_rotation, 1);
+    put(f, (uint64_t)(uint8_t)game->current_x, 1);
+    put(f, (uint64_t)(uint8_t)game->current_y, 1);
+}
+
+// Read a position and move the mirrored piece there; false if it cannot be
+static bool decode_position(Cursor *c, GameState *game) {
+    int rotation = (int)get(c, 1);
+    int x = (int8_t)get(c, 1);
+    int y = (int8_t)get(c, 1);
+    if (c->bad || rotation >= 4 || game->game_over ||
+        !tetris_can_place(game, game->current_type, rotation, x, y)) {
+        return false;
+    }
+    game->current_rotation = rotation;
+    game->current_x = x;
+    game->current_y = y;
+    return true;
+}
+
+NetApplyStatus net_reader_apply(NetReader *reader, GameState *game, unsigned *events,
+                                bool *snapshot) {
+    size_t pos = 0;
+    NetApplyStatus status = NET_APPLY_OK;
+    while (status == NET_APPLY_OK && reader->len - pos >= 2) {
+        size_t len = reader->buf[pos] | (size_t)reader->buf[pos + 1] << 8;
+        if (len == 0 || len > NET_FRAME_MAX) {
+            status = NET_APPLY_BAD;
+            break;
+        }
+        if (reader->len - pos - 2 < len) break;  // Wait for the rest
+
+        Cursor c = {.data = reader->buf + pos + 3, .len = len - 1};
+        switch (reader->buf[pos + 2]) {
+            case NET_MSG_SNAPSHOT:
+                if (!decode_snapshot(&c, game)) status = NET_APPLY_BAD;
+                *snapshot = true;
+                break;
+            case NET_MSG_PIECE:
+                if (!decode_position(&c, game)) status = NET_APPLY_DESYNC;
+                *events |= TETRIS_EVENT_MOVED;
+                break;
+            case NET_MSG_LOCK: {
+                if (!decode_position(&c, game)) {
+                    status = NET_APPLY_DESYNC;
+                    break;
+                }
+                uint32_t cleared = (uint32_t)get(&c, 4);
+                uint32_t hash = (uint32_t)get(&c, 4);
+                *events |= tetris_lock_piece(game);
+                if (c.bad || cleared != game->cleared_rows || hash != (uint32_t)game->board_hash) {
+                    status = NET_APPLY_DESYNC;
+                }
+                break;
+            }
+            default:
+                break;  // Unknown frames are skipped for forward compatibility
+        }
+        pos += 2 + len;
+    }
+    memmove(reader->buf, reader->buf + pos, reader->len - pos);
+    reader->len -= pos;
+    return status;
+}
+
+static void set_nonblocking(int fd) {
+    int flags = fcntl(fd, F_GETFL);
+    fcntl(fd, F_SETFL, flags | O_NONBLOCK);
+}
+
+int net_connect(const char *host, int port) {
+    char service[16];
+    snprintf(service, sizeof(service), "%d", port);
+    struct addrinfo hints = {.ai_family = AF_UNSPEC, .ai_socktype = SOCK_STREAM};
+    struct addrinfo *list;
+    if (getaddrinfo(host, service, &hints, &list) != 0) return -1;
+
+    int fd = -1;
+    for (struct addrinfo *ai = list; ai && fd < 0; ai = ai->ai_next) {
+        fd = socket(ai->ai_family, ai->ai_socktype | SOCK_CLOEXEC, ai->ai_protocol);
+        if (fd >= 0 && connect(fd, ai->ai_addr, ai->ai_addrlen) != 0) {
+            close(fd);
+            fd = -1;
+        }
+    }
+    freeaddrinfo(list);
+    if (fd >= 0) set_nonblocking(fd);
+    return fd;
+}
+
+// Server side
+
+typedef struct {
+    int fd;  // -1 for a free slot
+    uint8_t *backlog;
+    size_t backlog_len;
+} NetClient;
+
+typedef struct {
+    const NetServerConfig *config;
+    int epoll_fd, listen_fd;
+    NetClient *clients;
+    int max_clients, client_count;
+
+    GameState game;
+    uint64_t games_started;
+    AiMove target;
+    bool has_target;
+    int restart_steps;
+
+    uint8_t tick_buf[4 * NET_FRAME_MAX];
+    Frame tick;  // Frames produced by this step, sent to every client at once
+} NetServer;
+
+static uint64_t now_ms(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000 + (uint64_t)ts.tv_nsec / 1000000;
+}
+
+static void drop_client(NetServer *server, NetClient *client) {
+    epoll_ctl(server->epoll_fd, EPOLL_CTL_DEL, client->fd, NULL);
+    close(client->fd);
+    free(client->backlog);
+    client->fd = -1;
+    client->backlog = NULL;
+    client->backlog_len = 0;
+    server->client_count--;
+}
+
+// Write what the socket takes and queue the rest, so every client costs one
+// send per step; false if the client had to be dropped
+static bool send_to(NetServer *server, NetClient *client, const uint8_t *data, size_t len) {
+    if (client->backlog_len == 0) {
+        ssize_t sent = send(client->fd, data, len, MSG_NOSIGNAL | MSG_DONTWAIT);
+        if (sent < 0 && errno != EAGAIN && errno != EWOULDBLOCK) {
+            drop_client(server, client);
+            return false;
+        }
+        if (sent > 0) {
+            data += sent;
+            len -= (size_t)sent;
+        }
+        if (len == 0) return true;
+    }
+    if (client->backlog_len + len > CLIENT_BACKLOG_MAX) {
+        drop_client(server, client);
+        return false;
+    }
+    uint8_t *grown = realloc(client->backlog, client->backlog_len + len);
+    if (!grown) {
+        drop_client(server, client);
+        return false;
+    }
+    memcpy(grown + client->backlog_len, data, len);
+    client->backlog = grown;
+    client->backlog_len += len;
+    // Ask to be told when the socket drains
+    struct epoll_event ev = {.events = EPOLLIN | EPOLLOUT, .data.ptr = client};
+    epoll_ctl(server->epoll_fd, EPOLL_CTL_MOD, client->fd, &ev);
+    return true;
+}
+
+static void flush_backlog(NetServer *server, NetClient *client) {
+    ssize_t sent = send(client->fd, client->backlog, client->backlog_len,
+                        MSG_NOSIGNAL | MSG_DONTWAIT);
+    if (sent < 0) {
+        if (errno != EAGAIN && errno != EWOULDBLOCK) drop_client(server, client);
+        return;
+    }
+    client->backlog_len -= (size_t)sent;
+    memmove(client->backlog, client->backlog + sent, client->backlog_len);
+    if (client->backlog_len == 0) {
+        struct epoll_event ev = {.events = EPOLLIN, .data.ptr = client};
+        epoll_ctl(server->epoll_fd, EPOLL_CTL_MOD, client->fd, &ev);
+    }
+}
+
+static void accept_clients(NetServer *server) {
+    for (;;) {
+        int fd = accept(server->listen_fd, NULL, NULL);
+        if (fd < 0) return;
+        set_nonblocking(fd);
+        if (server->client_count == server->max_clients) {
+            close(fd);
+            continue;
+        }
+        NetClient *client = server->clients;
+        while (client->fd >= 0) client++;
+        int one = 1;
+        setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+        client->fd = fd;
+        server->client_count++;
+        struct epoll_event ev = {.events = EPOLLIN, .data.ptr = client};
+        epoll_ctl(server->epoll_fd, EPOLL_CTL_ADD, fd, &ev);
+
+        uint8_t buf[NET_FRAME_MAX];
+        Frame join = {.data = buf, .cap = sizeof(buf)};
+        encode_snapshot(&join, &server->game);
+        send_to(server, client, join.data, join.len);
+    }
+}
+
+// Spectators have nothing to say; read to notice hang-ups
+static void read_client(NetServer *server, NetClient *client) {
+    uint8_t scratch[256];
+    for (;;) {
+        ssize_t got = recv(client->fd, scratch, sizeof(scratch), MSG_DONTWAIT);
+        if (got > 0) continue;
+        if (got == 0 || (errno != EAGAIN && errno != EWOULDBLOCK)) drop_client(server, client);
+        return;
+    }
+}
+
+static void start_game(NetServer *server) {
+    const NetServerConfig *config = server->config;
+    tetris_init_randomizer(&server->game, sim_game_seed(config->seed, server->games_started++),
+                           config->randomizer);
+    server->has_target = false;
+    encode_snapshot(&server->tick, &server->game);
+}
+
+// One server step: steer towards the autoplayer's target one input at a
+// time, otherwise fall a row or lock
+static void step_game(NetServer *server) {
+    GameState *game = &server->game;
+    if (game->game_over) {
+        if (--server->restart_steps <= 0) start_game(server);
+        return;
+    }
+    if (!server->has_target) {
+        server->has_target = ai_best_move(game, &ai_default_weights, NULL, &server->target);
+    }
+
+    TetrisInput input = TETRIS_INPUT_SOFT_DROP;
+    if (server->has_target && game->current_rotation != server->target.rotation) {
+        input = TETRIS_INPUT_ROTATE;
+    } else if (server->has_target && game->current_x != server->target.x) {
+        input = game->current_x < server->target.x ? TETRIS_INPUT_RIGHT : TETRIS_INPUT_LEFT;
+    }
+    if (tetris_apply_input(game, input) ||
+        (input != TETRIS_INPUT_SOFT_DROP && tetris_apply_input(game, TETRIS_INPUT_SOFT_DROP))) {
+        size_t start = begin_frame(&server->tick, NET_MSG_PIECE);
+        encode_position(&server->tick, game);
+        end_frame(&server->tick, start);
+        return;
+    }
+
+    // Resting on the stack: lock where it is
+    size_t start = begin_frame(&server->tick, NET_MSG_LOCK);
+    encode_position(&server->tick, game);
+    unsigned events = tetris_lock_piece(game);
+    put(&server->tick, game->cleared_rows, 4);
+    put(&server->tick, (uint32_t)game->board_hash, 4);
+    end_frame(&server->tick, start);
+    server->has_target = false;
+    if (events & TETRIS_EVENT_GAME_OVER) {
+        server->restart_steps = RESTART_DELAY_MS / server->config->tick_ms;
+    }
+}
+
+static void broadcast(NetServer *server) {
+    if (server->tick.len == 0) return;
+    for (int i = 0; i < server->max_clients; i++) {
+        NetClient *client = &server->clients[i];
+        if (client->fd >= 0) send_to(server, client, server->tick.data, server->tick.len);
+    }
+    server->tick.len = 0;
+}
+
+static int open_listener(int port) {
+    int fd = socket(AF_INET6, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+    if (fd < 0) return -1;
+    int one = 1, zero = 0;
+    setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one));
+    setsockopt(fd, IPPROTO_IPV6, IPV6_V6ONLY, &zero, sizeof(zero));
+    struct sockaddr_in6 addr = {.sin6_family = AF_INET6, .sin6_port = htons((uint16_t)port),
+                                .sin6_addr = IN6ADDR_ANY_INIT};
+    if (bind(fd, (struct sockaddr *)&addr, sizeof(addr)) != 0 || listen(fd, SOMAXCONN) != 0) {
+        close(fd);
+        return -1;
+    }
+    return fd;
+}
+
+int net_serve(const NetServerConfig *config) {
+    NetServer *server = calloc(1, sizeof(NetServer));
+    if (!server) return 1;
+    NetServerConfig defaults = *config;
+    if (defaults.tick_ms <= 0) defaults.tick_ms = NET_DEFAULT_TICK_MS;
+    if (defaults.max_clients <= 0) defaults.max_clients = DEFAULT_MAX_CLIENTS;
+    server->config = &defaults;
+    server->max_clients = defaults.max_clients;
+    server->tick = (Frame){.data = server->tick_buf, .cap = sizeof(server->tick_buf)};
+
+    server->clients = calloc((size_t)server->max_clients, sizeof(NetClient));
+    server->listen_fd = open_listener(config->port);
+    server->epoll_fd = epoll_create1(EPOLL_CLOEXEC);
+    if (!server->clients || server->listen_fd < 0 || server->epoll_fd < 0) {
+        fprintf(stderr, "serve: could not listen on port %d: %s\n", config->port, strerror(errno));
+        if (server->listen_fd >= 0) close(server->listen_fd);
+        if (server->epoll_fd >= 0) close(server->epoll_fd);
+        free(server->clients);
+        free(server);
+        return 1;
+    }
+    for (int i = 0; i < server->max_clients; i++) server->clients[i].fd = -1;
+    struct epoll_event ev = {.events = EPOLLIN, .data.ptr = NULL};
+    epoll_ctl(server->epoll_fd, EPOLL_CTL_ADD, server->listen_fd, &ev);
+
+    start_game(server);
+    server->tick.len = 0;  // Nobody to send the first snapshot to yet
+    fprintf(stderr, "serve: listening on port %d\n", config->port);
+
+    uint64_t next_step = now_ms() + (uint64_t)defaults.tick_ms;
+    struct epoll_event events[EPOLL_BATCH];
+    for (;;) {
+        uint64_t now = now_ms();
+        int timeout = next_step > now ? (int)(next_step - now) : 0;
+        int n = epoll_wait(server->epoll_fd, events, EPOLL_BATCH, timeout);
+        if (n < 0 && errno != EINTR) break;
+        for (int i = 0; i < n; i++) {
+            NetClient *client = events[i].data.ptr;
+            if (!client) {
+                accept_clients(server);
+            } else if (events[i].events & (EPOLLERR | EPOLLHUP)) {
+                drop_client(server, client);
+            } else {
+                if (events[i].events & EPOLLOUT) flush_backlog(server, client);
+                if (client->fd >= 0 && (events[i].events & EPOLLIN)) read_client(server, client);
+            }
+        }
+
+        now = now_ms();
+        if (now < next_step) continue;
+        step_game(server);
+        broadcast(server);
+        next_step += (uint64_t)defaults.tick_ms;
+        // After a stall, carry on from now instead of bursting to catch up
+        if (next_step < now) next_step = now + (uint64_t)defaults.tick_ms;
+    }
+
+    fprintf(stderr, "serve: %s\n", strerror(errno));
+    close(server->listen_fd);
+    close(server->epoll_fd);
+    free(server->clients);
+    free(server);
+    return 1;
+}
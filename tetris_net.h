@@ -0,0 +1,67 @@
+#ifndef TETRIS_NET_H
+#define TETRIS_NET_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "tetris_engine.h"
+
+// Spectator streaming. The server plays games with the autoplayer and every
+// client mirrors them on its own engine: a snapshot carries the whole
+// state, generator included, so afterwards the server only sends where the
+// piece moved and where it locked. The client locks it itself and checks
+// the cleared rows and board hash it is sent against its own.
+//
+// Frames are len:u16le type:u8 payload[len - 1], integers little-endian:
+//
+//   NET_MSG_SNAPSHOT  version:u8 snapshot[TETRIS_SNAPSHOT_SIZE], the
+//                     TetrisSnapshot of the game, sent on join and on
+//                     every new game
+//   NET_MSG_PIECE     rotation:u8 x:i8 y:i8
+//   NET_MSG_LOCK      rotation:u8 x:i8 y:i8 cleared_rows:u32 board_hash:u32
+//                     (low half of GameState.board_hash after the lock)
+
+#define NET_VERSION 3
+#define NET_DEFAULT_TICK_MS 50
+#define NET_FRAME_MAX 512
+
+enum {
+    NET_MSG_SNAPSHOT = 1,
+    NET_MSG_PIECE = 2,
+    NET_MSG_LOCK = 3,
+};
+
+typedef struct {
+    int port;
+    uint64_t seed;
+    TetrisRandomizer randomizer;
+    int tick_ms;      // Server step: one autoplayer input or gravity step
+    int max_clients;  // 0 for the default
+} NetServerConfig;
+
+// Run the spectator server until a fatal error; returns non-zero on failure
+int net_serve(const NetServerConfig *config) __attribute__((nonnull));
+
+// Open a TCP connection to host:port, non-blocking once connected; -1 on error
+int net_connect(const char *host, int port) __attribute__((nonnull));
+
+// Reassembles frames from a socket stream
+typedef struct {
+    uint8_t buf[4 * NET_FRAME_MAX];
+    size_t len;
+} NetReader;
+
+typedef enum {
+    NET_APPLY_OK,
+    NET_APPLY_DESYNC,  // A lock disagreed with the local mirror
+    NET_APPLY_BAD,     // Malformed frame
+} NetApplyStatus;
+
+// Apply the complete frames in reader to game, consuming them; events
+// accumulates TETRIS_EVENT_* bits and *snapshot is set if a snapshot
+// replaced the board
+NetApplyStatus net_reader_apply(NetReader *reader, GameState *game, unsigned *events,
+                                bool *snapshot) __attribute__((nonnull));
+
+#endif
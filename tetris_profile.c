@@ -0,0 +1,64 @@
+#include "tetris_profile.h"
+
+#include <string.h>
+
+int prof_bucket_index(uint64_t ns) {
+    if (ns < PROF_SUB_BUCKETS) return (int)ns;
+    int msb = 63 - __builtin_clzll(ns);
+    int sub = (int)((ns >> (msb - PROF_SUB_BITS)) & (PROF_SUB_BUCKETS - 1));
+    int index = (msb - PROF_SUB_BITS + 1) * PROF_SUB_BUCKETS + sub;
+    return index < PROF_BUCKETS ? index : PROF_BUCKETS - 1;
+}
+
+// Exclusive upper bound of a bucket, inverse of prof_bucket_index()
+static uint64_t bucket_limit(int index) {
+    if (index < PROF_SUB_BUCKETS) return (uint64_t)index + 1;
+    int msb = index / PROF_SUB_BUCKETS + PROF_SUB_BITS - 1;
+    uint64_t sub = (uint64_t)(index % PROF_SUB_BUCKETS);
+    return ((PROF_SUB_BUCKETS + sub + 1) << (msb - PROF_SUB_BITS));
+}
+
+void prof_record(ProfHistogram *hist, uint64_t ns) {
+    hist->buckets[prof_bucket_index(ns)]++;
+    hist->count++;
+    hist->total_ns += ns;
+    if (ns > hist->max_ns) hist->max_ns = ns;
+}
+
+uint64_t prof_percentile(const ProfHistogram *hist, double quantile) {
+    if (!hist->count) return 0;
+    uint64_t rank = (uint64_t)(quantile * (double)(hist->count - 1)) + 1;
+    uint64_t seen = 0;
+    for (int i = 0; i < PROF_BUCKETS; i++) {
+        seen += hist->buckets[i];
+        if (seen >= rank) {
+            uint64_t limit = bucket_limit(i);
+            return limit < hist->max_ns ? limit : hist->max_ns;
+        }
+    }
+    return hist->max_ns;
+}
+
+void prof_reset(ProfHistogram *hist) {
+    const char *name = hist->name;
+    memset(hist, 0, sizeof(*hist));
+    hist->name = name;
+}
+
+void prof_dump(FILE *out, const ProfHistogram *hist) {
+    fprintf(out, "%s: n=%llu mean=%.0fns p50=%lluns p99=%lluns max=%lluns\n",
+            hist->name, (unsigned long long)hist->count,
+            hist->count ? (double)hist->total_ns / (double)hist->count : 0.0,
+            (unsigned long long)prof_percentile(hist, 0.50),
+            (unsigned long long)prof_percentile(hist, 0.99),
+            (unsigned long long)hist->max_ns);
+    uint64_t low = 0;
+    for (int i = 0; i < PROF_BUCKETS; i++) {
+        uint64_t limit = bucket_limit(i);
+        if (hist->buckets[i]) {
+            fprintf(out, "  [%llu, %llu) %u\n", (unsigned long long)low,
+                    (unsigned long long)limit, hist->buckets[i]);
+        }
+        low = limit;
+    }
+}
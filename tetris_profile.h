@@ -0,0 +1,50 @@
+#ifndef TETRIS_PROFILE_H
+#define TETRIS_PROFILE_H
+
+#include <stdint.h>
+#include <stdio.h>
+#include <time.h>
+
+// Fixed-bucket latency histograms for hot-path probes. Buckets are
+// log-linear: each power of two of nanoseconds is split into
+// PROF_SUB_BUCKETS equal slices, so recording is a few shifts and an
+// increment and percentiles are accurate to ~25%. Not thread-safe; keep
+// one histogram per thread.
+
+#define PROF_SUB_BITS 2
+#define PROF_SUB_BUCKETS (1 << PROF_SUB_BITS)
+#define PROF_BUCKETS (40 * PROF_SUB_BUCKETS)  // Up to ~18 minutes
+
+typedef struct {
+    const char *name;
+    uint64_t count;
+    uint64_t total_ns;
+    uint64_t max_ns;
+    uint32_t buckets[PROF_BUCKETS];
+} ProfHistogram;
+
+static inline uint64_t prof_now_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000u + (uint64_t)ts.tv_nsec;
+}
+
+// Bucket a latency falls in, for histograms kept outside ProfHistogram
+int prof_bucket_index(uint64_t ns);
+
+void prof_record(ProfHistogram *hist, uint64_t ns) __attribute__((nonnull));
+
+// Record the time elapsed since `start` (from prof_now_ns)
+static inline void prof_record_since(ProfHistogram *hist, uint64_t start) {
+    prof_record(hist, prof_now_ns() - start);
+}
+
+// Upper bound of the bucket holding the given quantile (0..1), in ns
+uint64_t prof_percentile(const ProfHistogram *hist, double quantile) __attribute__((nonnull));
+
+void prof_reset(ProfHistogram *hist) __attribute__((nonnull));
+
+// Print a summary line and the non-empty buckets
+void prof_dump(FILE *out, const ProfHistogram *hist) __attribute__((nonnull));
+
+#endif
@@ -0,0 +1,244 @@
+#include "tetris_replay.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+#define REPLAY_END 7
+#define INPUT_BITS 3
+
+static const uint8_t replay_magic[4] = {'T', 'T', 'R', 'P'};
+
+static void writer_flush(ReplayWriter *writer) {
+    if (writer->file) {
+        if (writer->len && fwrite(writer->buf, 1, writer->len, writer->file) != writer->len) {
+            writer->failed = true;
+        }
+    } else if (!writer->failed) {
+        if (writer->size + writer->len > writer->capacity) {
+            size_t capacity = writer->capacity ? writer->capacity * 2 : REPLAY_BUFFER_SIZE;
+            while (capacity < writer->size + writer->len) capacity *= 2;
+            uint8_t *grown = realloc(writer->data, capacity);
+            if (!grown) {
+                writer->failed = true;
+                writer->len = 0;
+                return;
+            }
+            writer->data = grown;
+            writer->capacity = capacity;
+        }
+        memcpy(writer->data + writer->size, writer->buf, writer->len);
+        writer->size += writer->len;
+    }
+    writer->len = 0;
+}
+
+static void write_varint(ReplayWriter *writer, uint64_t value) {
+    // At most 10 bytes; flush first so an encoding never straddles the buffer
+    if (writer->len + 10 > sizeof(writer->buf)) writer_flush(writer);
+    do {
+        uint8_t byte = value & 0x7f;
+        value >>= 7;
+        writer->buf[writer->len++] = byte | (value ? 0x80 : 0);
+    } while (value);
+}
+
+static void write_header(ReplayWriter *writer, uint64_t seed, TetrisRandomizer randomizer) {
+    writer->open = true;
+    memcpy(writer->buf, replay_magic, sizeof(replay_magic));
+    writer->buf[4] = REPLAY_VERSION;
+    writer->buf[5] = (uint8_t)randomizer;
+    writer->buf[6] = BOARD_WIDTH;
+    writer->buf[7] = BOARD_HEIGHT;
+    for (int i = 0; i < 8; i++) writer->buf[8 + i] = (uint8_t)(seed >> (8 * i));
+    writer->len = REPLAY_HEADER_SIZE;
+}
+
+bool replay_writer_open(ReplayWriter *writer, const char *path, uint64_t seed,
+                        TetrisRandomizer randomizer) {
+    memset(writer, 0, offsetof(ReplayWriter, buf));
+    writer->file = fopen(path, "wb");
+    if (!writer->file) return false;
+    write_header(writer, seed, randomizer);
+    return true;
+}
+
+bool replay_writer_open_memory(ReplayWriter *writer, uint64_t seed,
+                               TetrisRandomizer randomizer) {
+    memset(writer, 0, offsetof(ReplayWriter, buf));
+    write_header(writer, seed, randomizer);
+    return true;
+}
+
+void replay_write_input(ReplayWriter *writer, uint32_t tick, TetrisInput input) {
+    if (!writer->open) return;
+    uint64_t delta = tick - writer->last_tick;
+    writer->last_tick = tick;
+    write_varint(writer, (delta << INPUT_BITS) | (uint64_t)input);
+}
+
+bool replay_writer_close(ReplayWriter *writer, const GameState *game) {
+    if (!writer->open) return false;
+    uint64_t delta = game->ticks - writer->last_tick;
+    write_varint(writer, (delta << INPUT_BITS) | REPLAY_END);
+    write_varint(writer, (uint64_t)game->score);
+    write_varint(writer, (uint64_t)game->lines);
+    write_varint(writer, (uint64_t)game->pieces);
+    writer_flush(writer);
+    if (writer->file && fclose(writer->file) != 0) writer->failed = true;
+    writer->file = NULL;
+    writer->open = false;
+    return !writer->failed;
+}
+
+static bool read_varint(ReplayReader *reader, uint64_t *value) {
+    uint64_t result = 0;
+    for (int shift = 0; shift < 64; shift += 7) {
+        if (reader->pos >= reader->size) return false;
+        uint8_t byte = reader->data[reader->pos++];
+        result |= (uint64_t)(byte & 0x7f) << shift;
+        if (!(byte & 0x80)) {
+            *value = result;
+            return true;
+        }
+    }
+    return false;
+}
+
+bool replay_reader_init(ReplayReader *reader, const uint8_t *data, size_t size) {
+    memset(reader, 0, sizeof(*reader));
+    if (size < REPLAY_HEADER_SIZE || memcmp(data, replay_magic, sizeof(replay_magic)) != 0 ||
+        data[4] != REPLAY_VERSION || data[5] >= TETRIS_RANDOMIZER_COUNT) {
+        return false;
+    }
+    // Recordings from before the size was stored are all 10x20
+    int width = data[6] ? data[6] : 10, height = data[7] ? data[7] : 20;
+    if (width != BOARD_WIDTH || height != BOARD_HEIGHT) return false;
+    reader->data = data;
+    reader->size = size;
+    reader->pos = REPLAY_HEADER_SIZE;
+    reader->info.randomizer = (TetrisRandomizer)data[5];
+    for (int i = 0; i < 8; i++) reader->info.seed |= (uint64_t)data[8 + i] << (8 * i);
+    return true;
+}
+
+int replay_reader_next(ReplayReader *reader, uint32_t *tick, TetrisInput *input) {
+    uint64_t record;
+    if (!read_varint(reader, &record)) return -1;
+    uint64_t next = reader->tick + (record >> INPUT_BITS);
+    if (next > UINT32_MAX) return -1;
+    reader->tick = (uint32_t)next;
+
+    unsigned code = record & ((1u << INPUT_BITS) - 1);
+    if (code == REPLAY_END) {
+        uint64_t score, lines, pieces;
+        if (!read_varint(reader, &score) || !read_varint(reader, &lines) ||
+            !read_varint(reader, &pieces) || score > INT32_MAX || lines > INT32_MAX ||
+            pieces > INT32_MAX) {
+            return -1;
+        }
+        reader->info.score = (int)score;
+        reader->info.lines = (int)lines;
+        reader->info.pieces = (int)pieces;
+        reader->info.ticks = reader->tick;
+        return 0;
+    }
+    if (code >= TETRIS_INPUT_COUNT) return -1;
+
+    *tick = reader->tick;
+    *input = (TetrisInput)code;
+    reader->info.inputs++;
+    return 1;
+}
+
+// Run gravity until the recorded tick; false if the game ends first
+static bool advance_to(GameState *game, uint32_t tick) {
+    while (game->ticks < tick) {
+        // tetris_tick only reports no events once the game is over
+        if (!tetris_tick(game)) return false;
+    }
+    return true;
+}
+
+ReplayStatus replay_run(const uint8_t *data, size_t size, GameState *game,
+                        ReplayInfo *info) {
+    ReplayReader reader;
+    if (!replay_reader_init(&reader, data, size)) return REPLAY_CORRUPT;
+    tetris_init_randomizer(game, reader.info.seed, reader.info.randomizer);
+
+    ReplayStatus status = REPLAY_OK;
+    for (;;) {
+        uint32_t tick;
+        TetrisInput input;
+        int next = replay_reader_next(&reader, &tick, &input);
+        if (next < 0) {
+            status = REPLAY_CORRUPT;
+            break;
+        }
+        if (next == 0) {
+            if (!advance_to(game, reader.info.ticks) || game->score != reader.info.score ||
+                game->lines != reader.info.lines || game->pieces != reader.info.pieces) {
+                status = REPLAY_MISMATCH;
+            }
+            break;
+        }
+        // Only effective inputs are recorded, so one that does nothing means
+        // the game has diverged
+        if (!advance_to(game, tick) || !tetris_apply_input(game, input)) {
+            status = REPLAY_MISMATCH;
+            break;
+        }
+    }
+    *info = reader.info;
+    return status;
+}
+
+// FNV-1a over the low bytes of value, least significant first
+static uint64_t hash_bytes(uint64_t hash, uint64_t value, int bytes) {
+    for (int i = 0; i < bytes; i++) {
+        hash ^= (value >> (8 * i)) & 0xff;
+        hash *= 0x100000001b3ULL;
+    }
+    return hash;
+}
+
+uint64_t replay_board_hash(const GameState *game) {
+    // Every byte of both arrays; on 10-wide boards this is the six bytes per
+    // row existing recordings were hashed over
+    uint64_t hash = 0xcbf29ce484222325ULL;
+    for (int y = 0; y < BOARD_HEIGHT; y++) {
+        hash = hash_bytes(hash, game->rows[y], 2);
+        hash = hash_bytes(hash, game->colors[y], sizeof(TetrisColorRow));
+    }
+    return hash;
+}
+
+uint8_t *replay_load_file(const char *path, size_t *size) {
+    FILE *file = fopen(path, "rb");
+    if (!file) return NULL;
+
+    uint8_t *data = NULL;
+    size_t len = 0, capacity = 0;
+    for (;;) {
+        if (len == capacity) {
+            capacity = capacity ? capacity * 2 : REPLAY_BUFFER_SIZE;
+            uint8_t *grown = realloc(data, capacity);
+            if (!grown) {
+                free(data);
+                fclose(file);
+                return NULL;
+            }
+            data = grown;
+        }
+        size_t got = fread(data + len, 1, capacity - len, file);
+        len += got;
+        if (got == 0) break;
+    }
+    bool failed = ferror(file);
+    fclose(file);
+    if (failed) {
+        free(data);
+        return NULL;
+    }
+    *size = len;
+    return data;
+}
@@ -0,0 +1,98 @@
+#ifndef TETRIS_REPLAY_H
+#define TETRIS_REPLAY_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+
+#include "tetris_engine.h"
+
+// Deterministic replays. A game is fully determined by its seed, its
+// randomizer and the inputs applied between gravity steps, so a recording is a small header
+// followed by one varint per effective input:
+//
+//   "TTRP" version:u8 randomizer:u8 width:u8 height:u8 seed:u64le
+//   varint((ticks since previous record << 3) | input)   repeated
+//   varint((ticks since previous record << 3) | 7)       end marker
+//   varint(score) varint(lines) varint(pieces)          footer
+//
+// Bot games never wait on gravity, so they cost one byte per input.
+
+#define REPLAY_VERSION 1
+#define REPLAY_HEADER_SIZE 16
+#define REPLAY_BUFFER_SIZE 4096
+
+typedef struct {
+    FILE *file;      // NULL when recording to memory
+    bool open;
+    uint8_t *data;   // Memory recordings: the finished replay, owned by the caller
+    size_t size, capacity;
+    uint32_t last_tick;
+    size_t len;
+    bool failed;
+    uint8_t buf[REPLAY_BUFFER_SIZE];
+} ReplayWriter;
+
+// Summary of a recording, decoded from its header and footer
+typedef struct {
+    uint64_t seed;
+    TetrisRandomizer randomizer;
+    int score, lines, pieces;
+    uint32_t ticks;
+    size_t inputs;
+} ReplayInfo;
+
+typedef struct {
+    const uint8_t *data;
+    size_t size, pos;
+    uint32_t tick;
+    ReplayInfo info;
+} ReplayReader;
+
+typedef enum {
+    REPLAY_OK,
+    REPLAY_CORRUPT,   // Truncated or malformed stream
+    REPLAY_MISMATCH,  // Stream is valid but the game did not end as recorded
+} ReplayStatus;
+
+// Create path and write the header; false if it could not be opened
+bool replay_writer_open(ReplayWriter *writer, const char *path, uint64_t seed,
+                        TetrisRandomizer randomizer)
+    __attribute__((nonnull));
+
+// Record into a growing heap buffer instead; after replay_writer_close the
+// replay is in writer->data/size and the caller frees data
+bool replay_writer_open_memory(ReplayWriter *writer, uint64_t seed,
+                               TetrisRandomizer randomizer) __attribute__((nonnull));
+
+// Record an input applied after `tick` gravity steps
+void replay_write_input(ReplayWriter *writer, uint32_t tick, TetrisInput input)
+    __attribute__((nonnull));
+
+// Write the end marker and footer from the final state, then close the file;
+// false if any write or allocation failed
+bool replay_writer_close(ReplayWriter *writer, const GameState *game)
+    __attribute__((nonnull));
+
+// Parse the header; false if data is not a replay
+bool replay_reader_init(ReplayReader *reader, const uint8_t *data, size_t size)
+    __attribute__((nonnull));
+
+// Fetch the next input: 1 with *tick and *input set, 0 at the end of the
+// stream (reader->info is then complete), -1 if the stream is corrupt
+int replay_reader_next(ReplayReader *reader, uint32_t *tick, TetrisInput *input)
+    __attribute__((nonnull));
+
+// Replay a whole recording onto game as fast as possible
+ReplayStatus replay_run(const uint8_t *data, size_t size, GameState *game,
+                        ReplayInfo *info) __attribute__((nonnull));
+
+// 64-bit FNV-1a of the settled board, cells and colors; stored by corpora to
+// check replayed games end on the same board
+uint64_t replay_board_hash(const GameState *game) __attribute__((nonnull));
+
+// Read a whole file into a malloc'd buffer; NULL on error
+uint8_t *replay_load_file(const char *path, size_t *size) __attribute__((nonnull));
+
+#endif
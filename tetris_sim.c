@@ -0,0 +1,331 @@
+#include "tetris_sim.h"
+
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "tetris_profile.h"
+#include "tetris_replay.h"
+
+#define MAX_THREADS 256
+
+// Each worker owns a [lo, hi) range of game indices packed into one atomic
+// word. The owner pops from lo; idle workers steal the upper half of a
+// victim's range with a single compare-and-swap.
+typedef struct Worker {
+    _Alignas(64) _Atomic uint64_t range;
+    pthread_t thread;
+    SimTask task;
+    void *ctx;
+    struct Worker *all;
+    int id, count;
+} Worker;
+
+// Per-worker totals for sim_run, padded so workers never share a line
+typedef struct {
+    _Alignas(64) SimResult result;
+} Partial;
+
+typedef struct {
+    const SimConfig *config;
+    Partial *partials;
+} SimJob;
+
+#define RANGE(lo, hi) (((uint64_t)(hi) << 32) | (uint32_t)(lo))
+#define RANGE_LO(r) ((uint32_t)(r))
+#define RANGE_HI(r) ((uint32_t)((r) >> 32))
+
+uint64_t sim_game_seed(uint64_t seed, uint64_t index) {
+    // splitmix64 finalizer
+    uint64_t z = seed + (index + 1) * 0x9E3779B97F4A7C15ULL;
+    z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ULL;
+    z = (z ^ (z >> 27)) * 0x94D049BB133111EBULL;
+    return z ^ (z >> 31);
+}
+
+void sim_random_policy(GameState *game, TetrisRng *rng, void *ctx) {
+    (void)ctx;
+    int rotations = tetris_rng_below(rng, 4);
+    for (int i = 0; i < rotations; i++) tetris_rotate(game);
+    int shift = tetris_rng_below(rng, BOARD_WIDTH) - BOARD_WIDTH / 2;
+    int dx = shift < 0 ? -1 : 1;
+    for (int i = 0; i != shift; i += dx) {
+        if (!tetris_move(game, dx, 0)) break;
+    }
+}
+
+void sim_ai_policy(GameState *game, TetrisRng *rng, void *ctx) {
+    (void)rng;
+    const SimAiContext *search = ctx;
+    const AiWeights *weights = search && search->weights ? search->weights : &ai_default_weights;
+    AiMove move;
+    if (ai_best_move(game, weights, search ? search->cache : NULL, &move)) {
+        ai_apply_move(game, &move);
+    }
+}
+
+// Policies steer the piece directly, so recover the inputs from where it
+// ended up: rotations first, then shifts, as every policy applies them.
+// before is a scratch copy of the state the policy started from.
+static void record_placement(ReplayWriter *recorder, GameState *before,
+                             const GameState *after) {
+    int turns = (after->current_rotation - before->current_rotation) & 3;
+    for (int i = 0; i < turns; i++) {
+        tetris_apply_input(before, TETRIS_INPUT_ROTATE);
+        replay_write_input(recorder, after->ticks, TETRIS_INPUT_ROTATE);
+    }
+    int shift = after->current_x - before->current_x;
+    TetrisInput input = shift < 0 ? TETRIS_INPUT_LEFT : TETRIS_INPUT_RIGHT;
+    for (int i = 0; i < abs(shift); i++) replay_write_input(recorder, after->ticks, input);
+    replay_write_input(recorder, after->ticks, TETRIS_INPUT_HARD_DROP);
+}
+
+// Where a game reports to, if anywhere
+typedef struct {
+    TelemetryRing *ring;
+    uint32_t capacity;
+    uint32_t game;
+} Reporter;
+
+// The same loop as play_game with the policy and the lock timed, kept apart
+// so untimed games pay nothing for it
+static void play_reported(GameState *game, const SimConfig *config, TetrisRng *policy_rng,
+                          ReplayWriter *recorder, const Reporter *reporter) {
+    SimPolicy policy = config->policy ? config->policy : sim_random_policy;
+    TelemetryRing *ring = reporter->ring;
+    GameState before;
+    telemetry_game_start(ring, reporter->capacity, reporter->game, game);
+    while (!game->game_over) {
+        if (config->max_pieces && game->pieces > config->max_pieces) break;
+        if (recorder) before = *game;
+        uint64_t start = prof_now_ns();
+        policy(game, policy_rng, config->policy_ctx);
+        uint64_t placed = prof_now_ns();
+        telemetry_record(&ring->place, placed - start);
+        if (recorder) record_placement(recorder, &before, game);
+        unsigned events = tetris_hard_drop(game);
+        telemetry_record(&ring->lock, prof_now_ns() - placed);
+        telemetry_game_events(ring, reporter->capacity, reporter->game, game, events);
+    }
+}
+
+static void play_game(GameState *game, uint64_t seed, const SimConfig *config,
+                      TetrisRng *policy_rng, ReplayWriter *recorder,
+                      const Reporter *reporter) {
+    SimPolicy policy = config->policy ? config->policy : sim_random_policy;
+    GameState before;
+    tetris_init_randomizer(game, seed, config->randomizer);
+    if (reporter && reporter->ring) {
+        play_reported(game, config, policy_rng, recorder, reporter);
+        return;
+    }
+    while (!game->game_over) {
+        if (config->max_pieces && game->pieces > config->max_pieces) break;
+        if (recorder) before = *game;
+        policy(game, policy_rng, config->policy_ctx);
+        if (recorder) record_placement(recorder, &before, game);
+        (void)tetris_hard_drop(game);
+    }
+}
+
+void sim_play_game(GameState *game, uint64_t seed, const SimConfig *config,
+                   TetrisRng *policy_rng) {
+    play_game(game, seed, config, policy_rng, NULL, NULL);
+}
+
+void sim_play_match(GameState players[2], uint64_t seed, const SimConfig *config,
+                    TetrisRng *policy_rng) {
+    SimPolicy policy = config->policy ? config->policy : sim_random_policy;
+    TetrisRng holes;
+    tetris_rng_seed(&holes, ~seed);
+    // Same-piece matches between deterministic policies would mirror each
+    // other and every attack would cancel, so each player draws its own
+    tetris_init_randomizer(&players[0], sim_game_seed(seed, 0), config->randomizer);
+    tetris_init_randomizer(&players[1], sim_game_seed(seed, 1), config->randomizer);
+    for (int turn = 0; !players[0].game_over && !players[1].game_over; turn ^= 1) {
+        GameState *self = &players[turn];
+        if (config->max_pieces && self->pieces > config->max_pieces) break;
+        policy(self, policy_rng, config->policy_ctx);
+        (void)tetris_hard_drop(self);
+        if (self->attack_lines) {
+            tetris_queue_garbage(&players[turn ^ 1], self->attack_lines,
+                                 tetris_rng_below(&holes, BOARD_WIDTH));
+        }
+    }
+}
+
+static bool pop_local(Worker *w, uint32_t *index) {
+    uint64_t r = atomic_load_explicit(&w->range, memory_order_acquire);
+    while (RANGE_LO(r) < RANGE_HI(r)) {
+        if (atomic_compare_exchange_weak_explicit(&w->range, &r,
+                RANGE(RANGE_LO(r) + 1, RANGE_HI(r)),
+                memory_order_acq_rel, memory_order_acquire)) {
+            *index = RANGE_LO(r);
+            return true;
+        }
+    }
+    return false;
+}
+
+static bool steal(Worker *w) {
+    Worker *all = w->all;
+    for (int k = 1; k < w->count; k++) {
+        Worker *victim = &all[(w->id + k) % w->count];
+        uint64_t r = atomic_load_explicit(&victim->range, memory_order_acquire);
+        while (RANGE_LO(r) < RANGE_HI(r)) {
+            uint32_t lo = RANGE_LO(r), hi = RANGE_HI(r);
+            uint32_t mid = lo + (hi - lo) / 2;
+            if (atomic_compare_exchange_weak_explicit(&victim->range, &r,
+                    RANGE(lo, mid), memory_order_acq_rel, memory_order_acquire)) {
+                // Our own range is empty, so no thief can race this store
+                atomic_store_explicit(&w->range, RANGE(mid, hi), memory_order_release);
+                return true;
+            }
+        }
+    }
+    return false;
+}
+
+static void *worker_main(void *arg) {
+    Worker *w = arg;
+    uint32_t index;
+
+    for (;;) {
+        if (!pop_local(w, &index)) {
+            if (!steal(w)) break;
+            continue;
+        }
+        w->task(index, w->id, w->ctx);
+    }
+    return NULL;
+}
+
+static double now_seconds(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (double)ts.tv_sec + (double)ts.tv_nsec * 1e-9;
+}
+
+int sim_thread_count(int threads, uint32_t count) {
+    if (threads <= 0) {
+        long online = sysconf(_SC_NPROCESSORS_ONLN);
+        threads = online > 0 ? (int)online : 1;
+    }
+    if (threads > MAX_THREADS) threads = MAX_THREADS;
+    if (count > 0 && (uint32_t)threads > count) threads = (int)count;
+    return threads < 1 ? 1 : threads;
+}
+
+int sim_parallel_for(uint32_t count, int threads, SimTask task, void *ctx) {
+    threads = sim_thread_count(threads, count);
+    Worker *workers = aligned_alloc(64, sizeof(Worker) * (size_t)threads);
+    if (!workers) return -1;
+    memset(workers, 0, sizeof(Worker) * (size_t)threads);
+
+    for (int i = 0; i < threads; i++) {
+        uint32_t lo = (uint32_t)((uint64_t)count * (uint32_t)i / (uint32_t)threads);
+        uint32_t hi = (uint32_t)((uint64_t)count * (uint32_t)(i + 1) / (uint32_t)threads);
+        atomic_init(&workers[i].range, RANGE(lo, hi));
+        workers[i].task = task;
+        workers[i].ctx = ctx;
+        workers[i].all = workers;
+        workers[i].id = i;
+        workers[i].count = threads;
+    }
+
+    int started = 0;
+    for (; started < threads; started++) {
+        if (pthread_create(&workers[started].thread, NULL, worker_main,
+                           &workers[started]) != 0) {
+            break;
+        }
+    }
+    // Any worker that failed to start has its indices stolen by the others
+    for (int i = 0; i < started; i++) pthread_join(workers[i].thread, NULL);
+    free(workers);
+    return started ? started : -1;
+}
+
+static void add_game(SimResult *partial, const GameState *game) {
+    partial->total_score += (uint64_t)game->score;
+    partial->total_lines += (uint64_t)game->lines;
+    partial->total_pieces += (uint64_t)game->pieces;
+    if (game->score > partial->best_score) partial->best_score = game->score;
+}
+
+static void sim_task(uint32_t index, int worker, void *ctx) {
+    SimJob *job = ctx;
+    const SimConfig *config = job->config;
+    SimResult *partial = &job->partials[worker].result;
+    TetrisRng policy_rng;
+    GameState game;
+
+    uint64_t seed = sim_game_seed(config->seed, index);
+    tetris_rng_seed(&policy_rng, sim_game_seed(~config->seed, index));
+    Reporter reporter = {.game = index};
+    if (config->telemetry) {
+        const TelemetryHeader *header = config->telemetry->header;
+        reporter.ring = telemetry_ring(config->telemetry, (uint32_t)worker % header->ring_count);
+        reporter.capacity = header->capacity;
+    }
+    if (config->versus) {
+        GameState players[2];
+        sim_play_match(players, seed, config, &policy_rng);
+        partial->games++;
+        add_game(partial, &players[0]);
+        add_game(partial, &players[1]);
+        if (players[0].game_over != players[1].game_over) {
+            partial->wins[players[0].game_over ? 1 : 0]++;
+        }
+        return;
+    }
+    if (config->corpus) {
+        ReplayWriter recorder;
+        replay_writer_open_memory(&recorder, seed, config->randomizer);
+        play_game(&game, seed, config, &policy_rng, &recorder, &reporter);
+        bool recorded = replay_writer_close(&recorder, &game);
+        corpus_writer_add(config->corpus, index, recorder.data,
+                          recorded ? recorder.size : 0, &game);
+        free(recorder.data);
+    } else {
+        play_game(&game, seed, config, &policy_rng, NULL, &reporter);
+    }
+    partial->games++;
+    add_game(partial, &game);
+}
+
+int sim_run(const SimConfig *config, SimResult *result) {
+    uint32_t games = config->games > 0 ? (uint32_t)config->games : 0;
+    int threads = sim_thread_count(config->threads, games);
+    Partial *partials = aligned_alloc(64, sizeof(Partial) * (size_t)threads);
+    if (!partials) return -1;
+    memset(partials, 0, sizeof(Partial) * (size_t)threads);
+
+    SimJob job = {.config = config, .partials = partials};
+    double start = now_seconds();
+    int started = sim_parallel_for(games, threads, sim_task, &job);
+    double elapsed = now_seconds() - start;
+    if (started < 0) {
+        free(partials);
+        return -1;
+    }
+
+    memset(result, 0, sizeof(*result));
+    result->threads = started;
+    result->seconds = elapsed;
+    for (int i = 0; i < threads; i++) {
+        const SimResult *p = &partials[i].result;
+        result->games += p->games;
+        result->total_score += p->total_score;
+        result->total_lines += p->total_lines;
+        result->total_pieces += p->total_pieces;
+        if (p->best_score > result->best_score) result->best_score = p->best_score;
+        result->wins[0] += p->wins[0];
+        result->wins[1] += p->wins[1];
+    }
+    free(partials);
+    return 0;
+}
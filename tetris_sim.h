@@ -0,0 +1,90 @@
+#ifndef TETRIS_SIM_H
+#define TETRIS_SIM_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "tetris_ai.h"
+#include "tetris_corpus.h"
+#include "tetris_engine.h"
+#include "tetris_telemetry.h"
+
+// Headless batch simulator: runs independent games across a thread pool.
+// Game i is always seeded from (seed, i), so totals do not depend on the
+// thread count or on scheduling.
+
+// Chooses the placement of a freshly spawned piece by rotating and shifting
+// it; the simulator then hard-drops it. rng is seeded per game and
+// ctx is SimConfig.policy_ctx, shared read-only by all workers.
+typedef void (*SimPolicy)(GameState *game, TetrisRng *rng, void *ctx);
+
+typedef struct {
+    int games;
+    int threads;       // 0 picks the number of online CPUs
+    uint64_t seed;
+    int max_pieces;    // Per-game piece cap, 0 for unlimited
+    TetrisRandomizer randomizer;
+    SimPolicy policy;  // NULL picks sim_random_policy
+    void *policy_ctx;
+    CorpusWriter *corpus;  // Record every game into this corpus, or NULL; not with versus
+    bool versus;           // Each game is a two-player match trading garbage
+    Telemetry *telemetry;  // Events and latencies go to ring worker % ring_count, or NULL
+} SimConfig;
+
+// Totals and best_score are per player: a versus match adds both players to
+// them but counts once in games
+typedef struct {
+    int games;
+    int threads;
+    uint64_t total_score;
+    uint64_t total_lines;
+    uint64_t total_pieces;
+    int best_score;
+    int wins[2];  // Versus: matches won by each player; the rest hit max_pieces
+    double seconds;
+} SimResult;
+
+// Random rotation and column, drawn from the per-game policy generator
+void sim_random_policy(GameState *game, TetrisRng *rng, void *ctx);
+
+// Context for sim_ai_policy. A NULL weights plays ai_default_weights; the
+// cache is optional and may be shared by all workers.
+typedef struct {
+    const AiWeights *weights;
+    AiCache *cache;
+} SimAiContext;
+
+// Placement search from tetris_ai.h; ctx is a const SimAiContext *, or NULL
+// for ai_default_weights without a cache
+void sim_ai_policy(GameState *game, TetrisRng *rng, void *ctx);
+
+// Play one game to completion and return its final state
+void sim_play_game(GameState *game, uint64_t seed, const SimConfig *config,
+                   TetrisRng *policy_rng) __attribute__((nonnull));
+
+// Play a versus match: each player's pieces are seeded from the game's seed
+// and they place them in turn; every lock's attack goes to the opponent's
+// garbage queue with a hole column drawn from a generator of its own
+void sim_play_match(GameState players[2], uint64_t seed, const SimConfig *config,
+                    TetrisRng *policy_rng) __attribute__((nonnull));
+
+// Returns 0 on success, -1 if the worker threads could not be started
+int sim_run(const SimConfig *config, SimResult *result) __attribute__((nonnull));
+
+// Runs task(index, worker, ctx) for every index in [0, count) on the
+// work-stealing pool; worker is in [0, sim_thread_count(threads, count)) and
+// identifies the calling thread, for per-worker accumulators.
+typedef void (*SimTask)(uint32_t index, int worker, void *ctx);
+
+// Returns the number of workers that ran, or -1 if none could be started
+int sim_parallel_for(uint32_t count, int threads, SimTask task, void *ctx)
+    __attribute__((nonnull(3)));
+
+// Workers used for count items: threads, or the online CPUs if threads <= 0,
+// capped by count
+int sim_thread_count(int threads, uint32_t count);
+
+// Mix a base seed and a game index into an independent per-game seed
+uint64_t sim_game_seed(uint64_t seed, uint64_t index);
+
+#endif
@@ -0,0 +1,183 @@
+#include "tetris_telemetry.h"
+
+#include <fcntl.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#define HEADER_SPACE 64
+
+_Static_assert(sizeof(TelemetryHeader) <= HEADER_SPACE, "header must fit its slot");
+
+// shm_open wants a single leading slash
+static void segment_name(char *out, size_t size, const char *name) {
+    snprintf(out, size, "%s%s", name[0] == '/' ? "" : "/", name);
+}
+
+static uint64_t ring_stride(uint32_t capacity) {
+    uint64_t bytes = sizeof(TelemetryRing) + (uint64_t)capacity * sizeof(TelemetryEvent);
+    return (bytes + 63) & ~(uint64_t)63;
+}
+
+bool telemetry_create(Telemetry *telemetry, const char *name, uint32_t ring_count,
+                      uint32_t capacity) {
+    memset(telemetry, 0, sizeof(*telemetry));
+    if (ring_count == 0) return false;
+    if (capacity == 0) capacity = TELEMETRY_DEFAULT_CAPACITY;
+    if (capacity > (1u << 24)) return false;
+    if (capacity & (capacity - 1)) capacity = 1u << (32 - __builtin_clz(capacity));
+
+    char path[256];
+    segment_name(path, sizeof(path), name);
+    // Replace rather than truncate, so scrapers still mapping the old
+    // segment keep reading it instead of faulting
+    shm_unlink(path);
+    int fd = shm_open(path, O_RDWR | O_CREAT | O_EXCL, 0644);
+    if (fd < 0) return false;
+    uint64_t stride = ring_stride(capacity);
+    size_t size = HEADER_SPACE + (size_t)(stride * ring_count);
+    if (ftruncate(fd, (off_t)size) != 0) {
+        close(fd);
+        return false;
+    }
+    // The fresh segment reads as zeros: empty rings, zero counters
+    void *map = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    close(fd);
+    if (map == MAP_FAILED) return false;
+
+    TelemetryHeader *header = map;
+    header->version = TELEMETRY_VERSION;
+    header->ring_count = ring_count;
+    header->capacity = capacity;
+    header->event_size = sizeof(TelemetryEvent);
+    header->ring_size = sizeof(TelemetryRing);
+    header->ring_stride = stride;
+    header->region_size = size;
+    // Magic last, so a scraper never accepts a half-written header
+    atomic_thread_fence(memory_order_release);
+    header->magic = TELEMETRY_MAGIC;
+
+    telemetry->map = map;
+    telemetry->size = size;
+    telemetry->header = header;
+    return true;
+}
+
+bool telemetry_attach(Telemetry *telemetry, const char *name) {
+    memset(telemetry, 0, sizeof(*telemetry));
+    char path[256];
+    segment_name(path, sizeof(path), name);
+    int fd = shm_open(path, O_RDWR, 0);
+    if (fd < 0) return false;
+    struct stat st;
+    if (fstat(fd, &st) != 0 || st.st_size < HEADER_SPACE) {
+        close(fd);
+        return false;
+    }
+    size_t size = (size_t)st.st_size;
+    void *map = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    close(fd);
+    if (map == MAP_FAILED) return false;
+
+    // Validate everything the ring arithmetic depends on
+    const TelemetryHeader *header = map;
+    uint32_t capacity = header->capacity;
+    if (header->magic != TELEMETRY_MAGIC || header->version != TELEMETRY_VERSION ||
+        header->event_size != sizeof(TelemetryEvent) ||
+        header->ring_size != sizeof(TelemetryRing) || header->ring_count == 0 ||
+        capacity == 0 || (capacity & (capacity - 1)) ||
+        header->ring_stride != ring_stride(capacity) || header->region_size != size ||
+        HEADER_SPACE + header->ring_stride * header->ring_count > size) {
+        munmap(map, size);
+        return false;
+    }
+    telemetry->map = map;
+    telemetry->size = size;
+    telemetry->header = header;
+    return true;
+}
+
+void telemetry_close(Telemetry *telemetry) {
+    if (telemetry->map) munmap(telemetry->map, telemetry->size);
+    memset(telemetry, 0, sizeof(*telemetry));
+}
+
+// Single writer, so plain load/store pairs are enough and never retry
+static inline void bump(_Atomic uint64_t *counter, uint64_t by) {
+    uint64_t value = atomic_load_explicit(counter, memory_order_relaxed);
+    atomic_store_explicit(counter, value + by, memory_order_relaxed);
+}
+
+void telemetry_record(TelemetryLatency *latency, uint64_t ns) {
+    _Atomic uint32_t *bucket = &latency->buckets[prof_bucket_index(ns)];
+    atomic_store_explicit(bucket, atomic_load_explicit(bucket, memory_order_relaxed) + 1,
+                          memory_order_relaxed);
+    bump(&latency->count, 1);
+    bump(&latency->total_ns, ns);
+    if (ns > atomic_load_explicit(&latency->max_ns, memory_order_relaxed)) {
+        atomic_store_explicit(&latency->max_ns, ns, memory_order_relaxed);
+    }
+}
+
+static void publish(TelemetryRing *ring, uint32_t capacity, uint64_t now, uint32_t game,
+                    const GameState *state, TelemetryKind kind, int arg) {
+    TelemetryEvent event = {
+        .time_ns = now,
+        .game = game,
+        .kind = (uint16_t)kind,
+        .arg = (uint16_t)arg,
+        .score = (uint32_t)state->score,
+        .pieces = (uint32_t)state->pieces,
+    };
+    telemetry_publish(ring, capacity, &event);
+}
+
+void telemetry_game_events(TelemetryRing *ring, uint32_t capacity, uint32_t game,
+                           const GameState *state, unsigned events) {
+    uint64_t now = prof_now_ns();
+    if (events & TETRIS_EVENT_LINES) {
+        publish(ring, capacity, now, game, state, TELEMETRY_LINES,
+                __builtin_popcount(state->cleared_rows));
+    }
+    if (events & TETRIS_EVENT_LEVEL_UP) {
+        publish(ring, capacity, now, game, state, TELEMETRY_LEVEL_UP, state->level);
+    }
+    if (events & TETRIS_EVENT_GAME_OVER) {
+        publish(ring, capacity, now, game, state, TELEMETRY_GAME_OVER, 0);
+    } else if (events & TETRIS_EVENT_LANDED) {
+        publish(ring, capacity, now, game, state, TELEMETRY_SPAWN, state->current_type);
+    }
+}
+
+void telemetry_game_start(TelemetryRing *ring, uint32_t capacity, uint32_t game,
+                          const GameState *state) {
+    uint64_t now = prof_now_ns();
+    publish(ring, capacity, now, game, state, TELEMETRY_GAME_START, 0);
+    publish(ring, capacity, now, game, state, TELEMETRY_SPAWN, state->current_type);
+}
+
+size_t telemetry_poll(TelemetryRing *ring, uint32_t capacity, TelemetryEvent *out,
+                      size_t max) {
+    uint64_t tail = atomic_load_explicit(&ring->tail, memory_order_relaxed);
+    uint64_t head = atomic_load_explicit(&ring->head, memory_order_acquire);
+    size_t n = 0;
+    for (; n < max && tail + n < head; n++) {
+        out[n] = telemetry_slots(ring)[(tail + n) & (capacity - 1)];
+    }
+    atomic_store_explicit(&ring->tail, tail + n, memory_order_release);
+    return n;
+}
+
+void telemetry_read_latency(const TelemetryLatency *latency, ProfHistogram *out) {
+    const char *name = out->name;
+    memset(out, 0, sizeof(*out));
+    out->name = name;
+    out->count = atomic_load_explicit(&latency->count, memory_order_relaxed);
+    out->total_ns = atomic_load_explicit(&latency->total_ns, memory_order_relaxed);
+    out->max_ns = atomic_load_explicit(&latency->max_ns, memory_order_relaxed);
+    for (int i = 0; i < PROF_BUCKETS; i++) {
+        out->buckets[i] = atomic_load_explicit(&latency->buckets[i], memory_order_relaxed);
+    }
+}
@@ -0,0 +1,146 @@
+#ifndef TETRIS_TELEMETRY_H
+#define TETRIS_TELEMETRY_H
+
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "tetris_engine.h"
+#include "tetris_profile.h"
+
+// Shared-memory telemetry for fleet monitoring. A shm_open region holds one
+// single-producer/single-consumer ring per game thread plus per-ring latency
+// histograms, so an external agent can scrape events and counters without
+// signals, sockets or locks. Producers are wait-free: a full ring drops the
+// event and counts it, it never waits for the consumer.
+//
+// Region layout, native byte order since both sides run on one machine:
+//
+//   TelemetryHeader, padded to 64 bytes
+//   ring_count x { TelemetryRing, capacity x TelemetryEvent }, each
+//   ring_stride bytes apart
+//
+// Segments stay in /dev/shm after the producer exits, so a crashed run can
+// still be scraped; remove them with shm_unlink or rm.
+
+#define TELEMETRY_MAGIC 0x4d545454u  // "TTTM"
+#define TELEMETRY_VERSION 1
+#define TELEMETRY_DEFAULT_CAPACITY 4096
+
+typedef enum {
+    TELEMETRY_GAME_START = 1,
+    TELEMETRY_SPAWN,      // arg: piece type
+    TELEMETRY_LINES,      // arg: lines cleared by the lock
+    TELEMETRY_LEVEL_UP,   // arg: new level
+    TELEMETRY_GAME_OVER,
+} TelemetryKind;
+
+typedef struct {
+    uint64_t time_ns;  // prof_now_ns() of the producer
+    uint32_t game;     // Game index in the batch, or game number in the GUI
+    uint16_t kind;     // TelemetryKind
+    uint16_t arg;
+    uint32_t score;
+    uint32_t pieces;
+} TelemetryEvent;
+
+// Latency histogram with ProfHistogram's buckets. Written by the producer
+// alone with relaxed stores, so each field reads whole without tearing
+typedef struct {
+    _Atomic uint64_t count;
+    _Atomic uint64_t total_ns;
+    _Atomic uint64_t max_ns;
+    _Atomic uint32_t buckets[PROF_BUCKETS];
+} TelemetryLatency;
+
+typedef struct {
+    // Producer line
+    _Alignas(64) _Atomic uint64_t head;
+    uint64_t tail_cache;  // Last tail the producer saw, to skip the consumer's line
+    _Atomic uint64_t published;
+    _Atomic uint64_t dropped;
+    // Consumer line
+    _Alignas(64) _Atomic uint64_t tail;
+    // Producer-only counters
+    _Alignas(64) TelemetryLatency place;  // Policy time to choose a placement
+    TelemetryLatency lock;                // Land, clear lines and spawn
+} TelemetryRing;
+
+typedef struct {
+    uint32_t magic;
+    uint32_t version;
+    uint32_t ring_count;
+    uint32_t capacity;     // Events per ring, a power of two
+    uint32_t event_size;   // sizeof(TelemetryEvent), checked on attach
+    uint32_t ring_size;    // sizeof(TelemetryRing)
+    uint64_t ring_stride;  // Bytes from one ring to the next
+    uint64_t region_size;
+} TelemetryHeader;
+
+typedef struct {
+    uint8_t *map;
+    size_t size;
+    const TelemetryHeader *header;
+} Telemetry;
+
+// Create (or replace) the segment name with ring_count rings; capacity is
+// rounded up to a power of two, 0 for the default. A replaced segment stays
+// valid for whoever still has it mapped.
+bool telemetry_create(Telemetry *telemetry, const char *name, uint32_t ring_count,
+                      uint32_t capacity) __attribute__((nonnull));
+
+// Map an existing segment for scraping
+bool telemetry_attach(Telemetry *telemetry, const char *name) __attribute__((nonnull));
+
+void telemetry_close(Telemetry *telemetry) __attribute__((nonnull));
+
+static inline TelemetryRing *telemetry_ring(const Telemetry *telemetry, uint32_t i) {
+    return (TelemetryRing *)(telemetry->map + 64 + (size_t)i * telemetry->header->ring_stride);
+}
+
+static inline TelemetryEvent *telemetry_slots(TelemetryRing *ring) {
+    return (TelemetryEvent *)(ring + 1);
+}
+
+// Producer side. Wait-free: returns false and counts a drop when the ring
+// is full. capacity is the header's.
+static inline bool telemetry_publish(TelemetryRing *ring, uint32_t capacity,
+                                     const TelemetryEvent *event) {
+    uint64_t head = atomic_load_explicit(&ring->head, memory_order_relaxed);
+    if (head - ring->tail_cache >= capacity) {
+        ring->tail_cache = atomic_load_explicit(&ring->tail, memory_order_acquire);
+        if (head - ring->tail_cache >= capacity) {
+            uint64_t dropped = atomic_load_explicit(&ring->dropped, memory_order_relaxed);
+            atomic_store_explicit(&ring->dropped, dropped + 1, memory_order_relaxed);
+            return false;
+        }
+    }
+    telemetry_slots(ring)[head & (capacity - 1)] = *event;
+    atomic_store_explicit(&ring->head, head + 1, memory_order_release);
+    uint64_t published = atomic_load_explicit(&ring->published, memory_order_relaxed);
+    atomic_store_explicit(&ring->published, published + 1, memory_order_relaxed);
+    return true;
+}
+
+// Producer side: add one sample to a latency histogram
+void telemetry_record(TelemetryLatency *latency, uint64_t ns) __attribute__((nonnull));
+
+// Producer side: publish what a lock's TETRIS_EVENT_* bits say happened to
+// game, plus the spawn of its next piece
+void telemetry_game_events(TelemetryRing *ring, uint32_t capacity, uint32_t game,
+                           const GameState *state, unsigned events) __attribute__((nonnull));
+
+// Producer side: publish a TELEMETRY_GAME_START for a freshly initialized game
+void telemetry_game_start(TelemetryRing *ring, uint32_t capacity, uint32_t game,
+                          const GameState *state) __attribute__((nonnull));
+
+// Consumer side: move up to max events out of ring; returns how many
+size_t telemetry_poll(TelemetryRing *ring, uint32_t capacity, TelemetryEvent *out,
+                      size_t max) __attribute__((nonnull));
+
+// Consumer side: snapshot a latency histogram for prof_percentile/prof_dump
+void telemetry_read_latency(const TelemetryLatency *latency, ProfHistogram *out)
+    __attribute__((nonnull));
+
+#endif
@@ -0,0 +1,350 @@
+#include <math.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "tetris_ai.h"
+#include "tetris_engine.h"
+#include "tetris_profile.h"
+#include "tetris_sim.h"
+
+// Evolves the placement search weights with a (mu/mu, lambda) evolution
+// strategy: every generation samples a population around the mean with a
+// step size per weight, plays each candidate on the same seeded games, and
+// moves the mean and step sizes to the best mu. All candidates x games run
+// on the simulator's pool, against per-thread scratch states allocated
+// once, so nothing is allocated per game.
+
+#define WEIGHT_COUNT 4
+#define DEFAULT_POPULATION 32
+#define DEFAULT_GAMES 16
+#define DEFAULT_GENERATIONS 50
+#define DEFAULT_MAX_PIECES 500
+#define INITIAL_SIGMA 0.3
+#define MIN_SIGMA 1e-3
+#define CHECKPOINT_VERSION 1
+
+typedef struct {
+    double w[WEIGHT_COUNT];
+    double fitness;  // Mean lines per game
+} Candidate;
+
+typedef struct {
+    int population, games, max_pieces, threads;
+    TetrisRandomizer randomizer;
+    uint64_t seed;
+    int generation;  // Next generation to run
+    TetrisRng rng;   // Draws the populations
+    double mean[WEIGHT_COUNT];
+    double sigma[WEIGHT_COUNT];
+    Candidate best;  // Best candidate seen in any generation
+} Tuner;
+
+// Everything a generation needs, sized once up front
+typedef struct {
+    const Tuner *tuner;
+    Candidate *candidates;
+    AiWeights *weights;      // Per candidate
+    SimAiContext *contexts;  // Per candidate, pointing at weights
+    SimConfig *configs;      // Per candidate, pointing at contexts
+    uint32_t *lines;         // Per candidate x game
+    GameState *scratch;      // Per worker thread
+    uint64_t generation_seed;
+} Workspace;
+
+static void to_weights(const double *w, AiWeights *out) {
+    out->aggregate_height = (float)w[0];
+    out->lines = (float)w[1];
+    out->holes = (float)w[2];
+    out->bumpiness = (float)w[3];
+}
+
+// The score ranks placements, so only the direction of the weights matters;
+// keeping them at unit length makes the step sizes comparable
+static void normalize(double *w) {
+    double norm = 0;
+    for (int i = 0; i < WEIGHT_COUNT; i++) norm += w[i] * w[i];
+    norm = sqrt(norm);
+    if (norm == 0) return;
+    for (int i = 0; i < WEIGHT_COUNT; i++) w[i] /= norm;
+}
+
+// Standard normal by Box-Muller from the tuner's generator
+static double gaussian(TetrisRng *rng) {
+    double u = ((double)(tetris_rng_next(rng) >> 8) + 1.0) / 16777217.0;
+    double v = (double)(tetris_rng_next(rng) >> 8) / 16777216.0;
+    return sqrt(-2.0 * log(u)) * cos(2.0 * M_PI * v);
+}
+
+static void evaluate_task(uint32_t index, int worker, void *ctx) {
+    Workspace *ws = ctx;
+    uint32_t games = (uint32_t)ws->tuner->games;
+    uint32_t candidate = index / games, game = index % games;
+    // Every candidate plays the same games, so they are compared on equal terms
+    uint64_t seed = sim_game_seed(ws->generation_seed, game);
+    TetrisRng policy_rng;
+    tetris_rng_seed(&policy_rng, ~seed);
+    GameState *state = &ws->scratch[worker];
+    sim_play_game(state, seed, &ws->configs[candidate], &policy_rng);
+    ws->lines[index] = (uint32_t)state->lines;
+}
+
+static int by_fitness(const void *a, const void *b) {
+    double fa = ((const Candidate *)a)->fitness, fb = ((const Candidate *)b)->fitness;
+    return (fa < fb) - (fa > fb);
+}
+
+static bool run_generation(Tuner *tuner, Workspace *ws) {
+    int population = tuner->population;
+    for (int c = 0; c < population; c++) {
+        Candidate *cand = &ws->candidates[c];
+        for (int i = 0; i < WEIGHT_COUNT; i++) {
+            cand->w[i] = tuner->mean[i] + tuner->sigma[i] * gaussian(&tuner->rng);
+        }
+        normalize(cand->w);
+        to_weights(cand->w, &ws->weights[c]);
+    }
+    ws->generation_seed = sim_game_seed(tuner->seed, (uint64_t)tuner->generation);
+
+    uint32_t tasks = (uint32_t)population * (uint32_t)tuner->games;
+    if (sim_parallel_for(tasks, tuner->threads, evaluate_task, ws) < 0) return false;
+
+    for (int c = 0; c < population; c++) {
+        uint64_t total = 0;
+        for (int g = 0; g < tuner->games; g++) total += ws->lines[c * tuner->games + g];
+        ws->candidates[c].fitness = (double)total / tuner->games;
+    }
+    qsort(ws->candidates, (size_t)population, sizeof(Candidate), by_fitness);
+    if (ws->candidates[0].fitness > tuner->best.fitness) tuner->best = ws->candidates[0];
+
+    // Recombine the best half equally; the step sizes follow their spread
+    int mu = population / 2 > 0 ? population / 2 : 1;
+    for (int i = 0; i < WEIGHT_COUNT; i++) {
+        double mean = 0, spread = 0;
+        for (int c = 0; c < mu; c++) mean += ws->candidates[c].w[i];
+        mean /= mu;
+        for (int c = 0; c < mu; c++) {
+            double d = ws->candidates[c].w[i] - mean;
+            spread += d * d;
+        }
+        tuner->mean[i] = mean;
+        tuner->sigma[i] = fmax(sqrt(spread / mu), MIN_SIGMA);
+    }
+    normalize(tuner->mean);
+    tuner->generation++;
+    return true;
+}
+
+// Written to a temporary file and renamed over the old one, so a crash
+// mid-write never loses the previous checkpoint
+static bool save_checkpoint(const char *path, const Tuner *tuner, const Workspace *ws) {
+    char tmp[4096];
+    if (snprintf(tmp, sizeof(tmp), "%s.tmp", path) >= (int)sizeof(tmp)) return false;
+    FILE *out = fopen(tmp, "w");
+    if (!out) return false;
+    fprintf(out, "tetris-tune %d\n", CHECKPOINT_VERSION);
+    fprintf(out, "generation %d\n", tuner->generation);
+    fprintf(out, "games %d max_pieces %d randomizer %d\n", tuner->games, tuner->max_pieces,
+            tuner->randomizer);
+    fprintf(out, "seed %llu rng %llu\n", (unsigned long long)tuner->seed,
+            (unsigned long long)tuner->rng.state);
+    fprintf(out, "mean");
+    for (int i = 0; i < WEIGHT_COUNT; i++) fprintf(out, " %.17g", tuner->mean[i]);
+    fprintf(out, "\nsigma");
+    for (int i = 0; i < WEIGHT_COUNT; i++) fprintf(out, " %.17g", tuner->sigma[i]);
+    fprintf(out, "\nbest %.17g", tuner->best.fitness);
+    for (int i = 0; i < WEIGHT_COUNT; i++) fprintf(out, " %.17g", tuner->best.w[i]);
+    // The last population, best first, for inspection; resuming only needs
+    // the distribution and generator above
+    fprintf(out, "\npopulation %d\n", tuner->population);
+    for (int c = 0; c < tuner->population; c++) {
+        fprintf(out, "%.17g", ws->candidates[c].fitness);
+        for (int i = 0; i < WEIGHT_COUNT; i++) fprintf(out, " %.17g", ws->candidates[c].w[i]);
+        fputc('\n', out);
+    }
+    bool ok = !ferror(out);
+    if (fclose(out) != 0) ok = false;
+    if (!ok || rename(tmp, path) != 0) {
+        remove(tmp);
+        return false;
+    }
+    return true;
+}
+
+static bool read_weights(FILE *in, double *w) {
+    for (int i = 0; i < WEIGHT_COUNT; i++) {
+        if (fscanf(in, "%lf", &w[i]) != 1) return false;
+    }
+    return true;
+}
+
+// Restore the distribution, generator and run settings of a checkpoint
+static bool load_checkpoint(const char *path, Tuner *tuner) {
+    FILE *in = fopen(path, "r");
+    if (!in) return false;
+    int version, randomizer, population;
+    unsigned long long seed, rng;
+    bool ok = fscanf(in, "tetris-tune %d", &version) == 1 && version == CHECKPOINT_VERSION &&
+              fscanf(in, " generation %d", &tuner->generation) == 1 &&
+              fscanf(in, " games %d max_pieces %d randomizer %d", &tuner->games,
+                     &tuner->max_pieces, &randomizer) == 3 &&
+              fscanf(in, " seed %llu rng %llu", &seed, &rng) == 2 &&
+              fscanf(in, " mean") == 0 && read_weights(in, tuner->mean) &&
+              fscanf(in, " sigma") == 0 && read_weights(in, tuner->sigma) &&
+              fscanf(in, " best %lf", &tuner->best.fitness) == 1 &&
+              read_weights(in, tuner->best.w) &&
+              fscanf(in, " population %d", &population) == 1;
+    fclose(in);
+    if (!ok || tuner->games < 1 || population < 1 || randomizer < 0 ||
+        randomizer >= TETRIS_RANDOMIZER_COUNT) {
+        return false;
+    }
+    tuner->population = population;
+    tuner->randomizer = (TetrisRandomizer)randomizer;
+    tuner->seed = seed;
+    tuner->rng.state = rng;
+    return true;
+}
+
+static bool workspace_init(Workspace *ws, const Tuner *tuner) {
+    memset(ws, 0, sizeof(*ws));
+    size_t population = (size_t)tuner->population;
+    int threads = sim_thread_count(tuner->threads,
+                                   (uint32_t)tuner->population * (uint32_t)tuner->games);
+    ws->tuner = tuner;
+    ws->candidates = calloc(population, sizeof(Candidate));
+    ws->weights = calloc(population, sizeof(AiWeights));
+    ws->contexts = calloc(population, sizeof(SimAiContext));
+    ws->configs = calloc(population, sizeof(SimConfig));
+    ws->lines = calloc(population * (size_t)tuner->games, sizeof(uint32_t));
+    ws->scratch = aligned_alloc(64, sizeof(GameState) * (size_t)threads);
+    if (!ws->candidates || !ws->weights || !ws->contexts || !ws->configs || !ws->lines ||
+        !ws->scratch) {
+        return false;
+    }
+    for (size_t c = 0; c < population; c++) {
+        ws->contexts[c].weights = &ws->weights[c];
+        ws->configs[c] = (SimConfig){
+            .max_pieces = tuner->max_pieces,
+            .randomizer = tuner->randomizer,
+            .policy = sim_ai_policy,
+            .policy_ctx = &ws->contexts[c],
+        };
+    }
+    return true;
+}
+
+static void workspace_free(Workspace *ws) {
+    free(ws->candidates);
+    free(ws->weights);
+    free(ws->contexts);
+    free(ws->configs);
+    free(ws->lines);
+    free(ws->scratch);
+}
+
+static bool parse_count(const char *arg, int *out) {
+    char *end;
+    long value = strtol(arg, &end, 10);
+    if (*arg == '\0' || *end != '\0' || value < 0 || value > 1000000) return false;
+    *out = (int)value;
+    return true;
+}
+
+int main(int argc, char *argv[]) {
+    Tuner tuner = {
+        .population = DEFAULT_POPULATION,
+        .games = DEFAULT_GAMES,
+        .max_pieces = DEFAULT_MAX_PIECES,
+        .seed = 1,
+    };
+    int generations = DEFAULT_GENERATIONS;
+    const char *checkpoint = NULL, *resume = NULL;
+    bool ok = true;
+    for (int i = 1; i < argc && ok; i++) {
+        bool has_value = i + 1 < argc;
+        if (strcmp(argv[i], "--generations") == 0 && has_value) {
+            ok = parse_count(argv[++i], &generations);
+        } else if (strcmp(argv[i], "--population") == 0 && has_value) {
+            ok = parse_count(argv[++i], &tuner.population) && tuner.population >= 2;
+        } else if (strcmp(argv[i], "--games") == 0 && has_value) {
+            ok = parse_count(argv[++i], &tuner.games) && tuner.games >= 1;
+        } else if (strcmp(argv[i], "--max-pieces") == 0 && has_value) {
+            ok = parse_count(argv[++i], &tuner.max_pieces);
+        } else if (strcmp(argv[i], "--threads") == 0 && has_value) {
+            ok = parse_count(argv[++i], &tuner.threads);
+        } else if (strcmp(argv[i], "--seed") == 0 && has_value) {
+            char *end;
+            tuner.seed = strtoull(argv[++i], &end, 0);
+            ok = *end == '\0';
+        } else if (strcmp(argv[i], "--checkpoint") == 0 && has_value) {
+            checkpoint = argv[++i];
+        } else if (strcmp(argv[i], "--resume") == 0 && has_value) {
+            resume = argv[++i];
+        } else {
+            ok = false;
+        }
+    }
+    if (!ok) {
+        fprintf(stderr, "usage: %s [--generations N] [--population N] [--games N]\n"
+                "       [--max-pieces N] [--threads T] [--seed S]\n"
+                "       [--checkpoint FILE] [--resume FILE]\n", argv[0]);
+        return 2;
+    }
+
+    int threads = tuner.threads;
+    if (resume) {
+        // The checkpoint's settings win, so a resumed run continues the same search
+        if (!load_checkpoint(resume, &tuner)) {
+            fprintf(stderr, "tune: %s is not a readable checkpoint\n", resume);
+            return 1;
+        }
+        tuner.threads = threads;
+        printf("resumed %s at generation %d\n", resume, tuner.generation);
+    } else {
+        tetris_rng_seed(&tuner.rng, tuner.seed);
+        const AiWeights *w = &ai_default_weights;
+        double start[WEIGHT_COUNT] = {w->aggregate_height, w->lines, w->holes, w->bumpiness};
+        memcpy(tuner.mean, start, sizeof(start));
+        normalize(tuner.mean);
+        for (int i = 0; i < WEIGHT_COUNT; i++) tuner.sigma[i] = INITIAL_SIGMA;
+        tuner.best.fitness = -1;
+    }
+
+    Workspace ws;
+    if (!workspace_init(&ws, &tuner)) {
+        fprintf(stderr, "tune: out of memory\n");
+        workspace_free(&ws);
+        return 1;
+    }
+
+    printf("population %d  games %d  max pieces %d  seed %llu\n", tuner.population,
+           tuner.games, tuner.max_pieces, (unsigned long long)tuner.seed);
+    int status = 0;
+    for (int g = 0; g < generations; g++) {
+        double start = (double)prof_now_ns();
+        if (!run_generation(&tuner, &ws)) {
+            fprintf(stderr, "tune: could not start worker threads\n");
+            status = 1;
+            break;
+        }
+        double seconds = ((double)prof_now_ns() - start) / 1e9;
+        const Candidate *top = &ws.candidates[0];
+        printf("gen %4d  best %8.2f  median %8.2f  weights %+.4f %+.4f %+.4f %+.4f  %.2fs\n",
+               tuner.generation - 1, top->fitness, ws.candidates[tuner.population / 2].fitness,
+               top->w[0], top->w[1], top->w[2], top->w[3], seconds);
+        fflush(stdout);
+        if (checkpoint && !save_checkpoint(checkpoint, &tuner, &ws)) {
+            fprintf(stderr, "tune: could not write %s\n", checkpoint);
+            status = 1;
+            break;
+        }
+    }
+    printf("best %.2f lines/game: aggregate_height %.6f lines %.6f holes %.6f bumpiness %.6f\n",
+           tuner.best.fitness, tuner.best.w[0], tuner.best.w[1], tuner.best.w[2],
+           tuner.best.w[3]);
+    workspace_free(&ws);
+    return status;
+}